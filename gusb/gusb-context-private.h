@@ -12,6 +12,8 @@
 
 G_BEGIN_DECLS
 
+typedef void (*GUsbContextEmulateFunc)(GTask *task);
+
 libusb_context *
 _g_usb_context_get_context(GUsbContext *self);
 
@@ -21,5 +23,31 @@ const gchar *
 _g_usb_context_lookup_product(GUsbContext *self, guint16 vid, guint16 pid, GError **error);
 gboolean
 _g_usb_context_has_flag(GUsbContext *self, GUsbContextFlags flags);
+gboolean
+_g_usb_context_match_rules_check(GUsbContext *self, guint16 vid, guint16 pid, guint8 device_class);
+guint
+_g_usb_context_hotplug_collapse(const guint *keys,
+				const libusb_hotplug_event *events,
+				guint n_events,
+				gboolean *dropped);
+guint
+_g_usb_context_hotplug_debounce_timeout(guint debounce, guint64 held_ms);
+GBytes *
+_g_usb_context_intern_bytes(GUsbContext *self, GBytes *bytes);
+guint
+_g_usb_context_get_blob_count(GUsbContext *self);
+guint
+_g_usb_context_next_generation(GUsbContext *self);
+void
+_g_usb_context_emulate_task(GUsbContext *self, GTask *task, GUsbContextEmulateFunc func);
+JsonNode *
+_g_usb_context_get_cached_descriptors(GUsbContext *self, const gchar *key, const gchar *kind);
+void
+_g_usb_context_set_cached_descriptors(GUsbContext *self,
+				      const gchar *key,
+				      const gchar *kind,
+				      JsonNode *json_node);
+void
+_g_usb_context_remove_cached_descriptors(GUsbContext *self, const gchar *key);
 
 G_END_DECLS
@@ -15,20 +15,58 @@
 
 #include "config.h"
 
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+#endif
+
 #include <libusb.h>
+#if defined(HAVE_PTHREAD_SETSCHEDPARAM) || defined(HAVE_PTHREAD_SETAFFINITY_NP)
+#include <pthread.h>
+#endif
+#include <string.h>
 
 #include "gusb-context-private.h"
 #include "gusb-device-private.h"
+#include "gusb-json-common.h"
+#include "gusb-source-private.h"
 #include "gusb-util.h"
 
-enum { PROP_0, PROP_LIBUSB_CONTEXT, PROP_DEBUG_LEVEL, N_PROPERTIES };
+enum {
+	PROP_0,
+	PROP_LIBUSB_CONTEXT,
+	PROP_DEBUG_LEVEL,
+	PROP_EVENT_THREAD_NAME,
+	PROP_EVENT_THREAD_POLICY,
+	PROP_EVENT_THREAD_PRIORITY,
+	PROP_EVENT_THREAD_AFFINITY,
+	PROP_EVENT_SHARDS,
+	N_PROPERTIES
+};
 
 enum { DEVICE_ADDED_SIGNAL, DEVICE_REMOVED_SIGNAL, DEVICE_CHANGED_SIGNAL, LAST_SIGNAL };
 
 #define G_USB_CONTEXT_HOTPLUG_POLL_INTERVAL_DEFAULT 1000 /* ms */
+#define G_USB_CONTEXT_HOTPLUG_DEBOUNCE_MAX	    4	 /* windows */
 
 #define GET_PRIVATE(o) (g_usb_context_get_instance_private(o))
 
+/* the payloads shared between events, which may outlive the context */
+typedef struct {
+	volatile gint refcount;
+	GMutex mutex;
+	GHashTable *dict; /* of GBytes : GUsbContextBlob */
+} GUsbContextBlobs;
+
+/* an entry is removed when the last event using it is destroyed */
+typedef struct {
+	GUsbContextBlobs *blobs;
+	GBytes *bytes;
+	guint users;
+} GUsbContextBlob;
+
 /**
  * GUsbContextPrivate:
  *
@@ -37,21 +75,47 @@ enum { DEVICE_ADDED_SIGNAL, DEVICE_REMOVED_SIGNAL, DEVICE_CHANGED_SIGNAL, LAST_S
 typedef struct {
 	GMainContext *main_ctx;
 	GPtrArray *devices;
+	GPtrArray *devices_snapshot; /* nullable, immutable copy of devices, for any thread */
+	GMutex devices_mutex;	     /* held when changing devices and the indexes */
 	GPtrArray *devices_removed;
+	GHashTable *dict_removed; /* platform-id : generation */
+	GHashTable *devices_by_bus_address; /* bus<<8|address : GPtrArray of GUsbDevice */
+	GHashTable *devices_by_platform_id; /* platform-id : GPtrArray of GUsbDevice */
+	GHashTable *devices_by_vid_pid;	    /* vid<<16|pid : GPtrArray of GUsbDevice */
+	volatile guint generation;
 	GHashTable *dict_usb_ids;
 	GHashTable *dict_replug;
-	GThread *thread_event;
+	GPtrArray *replug_waiters; /* of GUsbContextReplugWaiter */
+	GUsbContextBlobs *blobs;
+	GHashTable *descriptor_cache; /* vid:pid:bcdDevice : JsonObject */
+	GMutex descriptor_cache_mutex;
+	GPtrArray *shards; /* of GUsbContextShard, the first owns ctx */
+	guint event_shards;
+	GUsbSource *source;
 	gboolean done_enumerate;
-	volatile gint thread_event_run;
+	GPtrArray *enumerate_tasks; /* of GTask, the first is running the enumeration */
+	gchar *thread_event_name;
+	GUsbContextThreadPolicy thread_event_policy;
+	gint thread_event_priority;
+	guint64 thread_event_affinity; /* CPU mask, or 0 for any */
 	guint hotplug_poll_id;
 	guint hotplug_poll_interval;
+	guint hotplug_debounce; /* ms */
+	guint hotplug_debounce_id;
+	gint64 hotplug_debounce_started; /* monotonic, us */
+	GPtrArray *hotplug_debounced; /* of GUsbContextIdleHelper */
 	int debug_level;
 	GUsbContextFlags flags;
 	libusb_context *ctx;
-	libusb_hotplug_callback_handle hotplug_id;
+	GArray *hotplug_ids; /* of GUsbContextHotplugId */
+	GArray *match_rules; /* of GUsbContextMatchRule */
 	GPtrArray *idle_events;
+	GPtrArray *idle_events_spare; /* only used in the main thread */
 	GMutex idle_events_mutex;
 	guint idle_events_id;
+	GQueue emulate_queue; /* of GUsbContextEmulateHelper */
+	GSource *emulate_source;
+	guint emulate_concurrency;
 } GUsbContextPrivate;
 
 /* not defined in FreeBSD */
@@ -65,6 +129,54 @@ typedef struct {
 	guint timeout_id;
 } GUsbContextReplugHelper;
 
+typedef struct {
+	GUsbContext *self; /* no-ref */
+	GTask *task;
+	GUsbDevice *device;
+	GUsbContextReplugFunc func;
+	gpointer user_data;
+	GDestroyNotify user_data_notify;
+	GSource *timeout_source;
+	GSource *cancellable_source;
+	gboolean removed;
+} GUsbContextReplugWaiter;
+
+typedef struct {
+	GTask *task;
+	GUsbContextEmulateFunc func;
+} GUsbContextEmulateHelper;
+
+typedef struct {
+	gint vid;
+	gint pid;
+	gint device_class;
+} GUsbContextMatchRule;
+
+typedef struct {
+	libusb_context *ctx;
+	libusb_hotplug_callback_handle handle;
+} GUsbContextHotplugId;
+
+/* a libusb context with its own event thread, owning each bus where bus % n is its index */
+typedef struct {
+	GUsbContext *self; /* no-ref */
+	libusb_context *ctx;
+	GThread *thread;
+	volatile gint run;
+	int completed; /* checked by libusb with the event lock held */
+} GUsbContextShard;
+
+typedef struct {
+	GUsbDevice *device;
+	GError *error;
+} GUsbContextOpenHelper;
+
+typedef struct {
+	GUsbContext *self;
+	GUsbDevice *device;
+	GCancellable *cancellable; /* nullable */
+} GUsbContextEnumerateHelper;
+
 static guint signals[LAST_SIGNAL] = {0};
 static GParamSpec *pspecs[N_PROPERTIES] = {
     NULL,
@@ -101,6 +213,82 @@ g_usb_context_replug_helper_free(GUsbContextReplugHelper *replug_helper)
 	g_free(replug_helper);
 }
 
+static void
+g_usb_context_replug_waiter_free(GUsbContextReplugWaiter *waiter)
+{
+	if (waiter->timeout_source != NULL) {
+		g_source_destroy(waiter->timeout_source);
+		g_source_unref(waiter->timeout_source);
+	}
+	if (waiter->cancellable_source != NULL) {
+		g_source_destroy(waiter->cancellable_source);
+		g_source_unref(waiter->cancellable_source);
+	}
+	if (waiter->user_data_notify != NULL)
+		waiter->user_data_notify(waiter->user_data);
+	g_object_unref(waiter->device);
+	g_object_unref(waiter->task);
+	g_free(waiter);
+}
+
+static void
+g_usb_context_blob_free(GUsbContextBlob *blob)
+{
+	g_bytes_unref(blob->bytes);
+	g_free(blob);
+}
+
+static GUsbContextBlobs *
+g_usb_context_blobs_ref(GUsbContextBlobs *blobs)
+{
+	g_atomic_int_inc(&blobs->refcount);
+	return blobs;
+}
+
+static void
+g_usb_context_blobs_unref(GUsbContextBlobs *blobs)
+{
+	if (!g_atomic_int_dec_and_test(&blobs->refcount))
+		return;
+	g_hash_table_unref(blobs->dict);
+	g_mutex_clear(&blobs->mutex);
+	g_free(blobs);
+}
+
+static void
+g_usb_context_blob_release_cb(gpointer user_data)
+{
+	GUsbContextBlob *blob = (GUsbContextBlob *)user_data;
+	GUsbContextBlobs *blobs = blob->blobs;
+	gboolean removed = FALSE;
+
+	g_mutex_lock(&blobs->mutex);
+	if (--blob->users == 0) {
+		g_hash_table_remove(blobs->dict, blob->bytes);
+		removed = TRUE;
+	}
+	g_mutex_unlock(&blobs->mutex);
+	if (removed)
+		g_usb_context_blobs_unref(blobs);
+}
+
+static void
+g_usb_context_emulate_helper_free(GUsbContextEmulateHelper *helper)
+{
+	g_object_unref(helper->task);
+	g_free(helper);
+}
+
+static void
+g_usb_context_enumerate_helper_free(GUsbContextEnumerateHelper *helper)
+{
+	g_object_unref(helper->self);
+	g_object_unref(helper->device);
+	if (helper->cancellable != NULL)
+		g_object_unref(helper->cancellable);
+	g_free(helper);
+}
+
 /* clang-format off */
 /**
  * g_usb_context_error_quark:
@@ -112,35 +300,199 @@ g_usb_context_replug_helper_free(GUsbContextReplugHelper *replug_helper)
 G_DEFINE_QUARK (g-usb-context-error-quark, g_usb_context_error)
 /* clang-format on */
 
+#ifndef HAVE_LIBUSB_INTERRUPT_EVENT_HANDLER
+static int LIBUSB_CALL
+g_usb_context_wake_cb(struct libusb_context *ctx,
+		      struct libusb_device *dev,
+		      libusb_hotplug_event event,
+		      void *user_data)
+{
+	return 0;
+}
+#endif
+
+/* otherwise the thread only sees the flag when the 2 second timeout expires */
+static void
+g_usb_context_event_thread_wake(GUsbContextShard *shard)
+{
+#ifdef HAVE_LIBUSB_INTERRUPT_EVENT_HANDLER
+	libusb_interrupt_event_handler(shard->ctx);
+#else
+	libusb_hotplug_callback_handle hotplug_id = 0;
+
+	/* libusb wakes the event handler when a hotplug callback is deregistered */
+	if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+		return;
+	if (libusb_hotplug_register_callback(shard->ctx,
+					     LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+					     0,
+					     LIBUSB_HOTPLUG_MATCH_ANY,
+					     LIBUSB_HOTPLUG_MATCH_ANY,
+					     LIBUSB_HOTPLUG_MATCH_ANY,
+					     g_usb_context_wake_cb,
+					     NULL,
+					     &hotplug_id) != LIBUSB_SUCCESS)
+		return;
+	libusb_hotplug_deregister_callback(shard->ctx, hotplug_id);
+#endif
+}
+
+static void
+g_usb_context_event_thread_stop(GUsbContext *self)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+
+	if (priv->shards == NULL)
+		return;
+
+	/* wake them all first so that they exit in parallel */
+	for (guint i = 0; i < priv->shards->len; i++) {
+		GUsbContextShard *shard = g_ptr_array_index(priv->shards, i);
+		if (shard->thread == NULL)
+			continue;
+		g_atomic_int_set(&shard->run, 0);
+		g_atomic_int_set(&shard->completed, 1);
+		g_usb_context_event_thread_wake(shard);
+	}
+	for (guint i = 0; i < priv->shards->len; i++) {
+		GUsbContextShard *shard = g_ptr_array_index(priv->shards, i);
+		if (shard->thread == NULL)
+			continue;
+		g_thread_join(shard->thread);
+		shard->thread = NULL;
+	}
+}
+
+static void
+g_usb_context_hotplug_deregister(GUsbContext *self)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+
+	for (guint i = 0; i < priv->hotplug_ids->len; i++) {
+		GUsbContextHotplugId id = g_array_index(priv->hotplug_ids, GUsbContextHotplugId, i);
+		libusb_hotplug_deregister_callback(id.ctx, id.handle);
+	}
+	g_array_set_size(priv->hotplug_ids, 0);
+}
+
+static void
+g_usb_context_shard_free(GUsbContextShard *shard)
+{
+	g_clear_pointer(&shard->ctx, libusb_exit);
+	g_free(shard);
+}
+
+static void
+g_usb_context_apply_debug_level(GUsbContext *self)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+
+	/* not yet initialized */
+	if (priv->shards == NULL) {
+#ifdef HAVE_LIBUSB_SET_OPTION
+		libusb_set_option(priv->ctx, LIBUSB_OPTION_LOG_LEVEL, priv->debug_level);
+#else
+		libusb_set_debug(priv->ctx, priv->debug_level);
+#endif
+		return;
+	}
+	for (guint i = 0; i < priv->shards->len; i++) {
+		GUsbContextShard *shard = g_ptr_array_index(priv->shards, i);
+#ifdef HAVE_LIBUSB_SET_OPTION
+		libusb_set_option(shard->ctx, LIBUSB_OPTION_LOG_LEVEL, priv->debug_level);
+#else
+		libusb_set_debug(shard->ctx, priv->debug_level);
+#endif
+	}
+}
+
+/* attaches to the main context rather than the global default */
+static guint
+g_usb_context_source_add(GUsbContext *self, guint interval, GSourceFunc func)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GSource) source = NULL;
+
+	source = interval > 0 ? g_timeout_source_new(interval) : g_idle_source_new();
+	g_source_set_callback(source, func, self, NULL);
+	return g_source_attach(source, priv->main_ctx);
+}
+
+static void
+g_usb_context_source_remove(GUsbContext *self, guint *id)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GSource *source;
+
+	if (*id == 0)
+		return;
+	source = g_main_context_find_source_by_id(priv->main_ctx, *id);
+	if (source != NULL)
+		g_source_destroy(source);
+	*id = 0;
+}
+
 static void
 g_usb_context_dispose(GObject *object)
 {
 	GUsbContext *self = G_USB_CONTEXT(object);
 	GUsbContextPrivate *priv = GET_PRIVATE(self);
 
-	/* this is safe to call even when priv->hotplug_id is unset */
-	if (g_atomic_int_dec_and_test(&priv->thread_event_run)) {
-		libusb_hotplug_deregister_callback(priv->ctx, priv->hotplug_id);
-		g_thread_join(priv->thread_event);
+	g_usb_context_event_thread_stop(self);
+	if (priv->hotplug_ids != NULL)
+		g_usb_context_hotplug_deregister(self);
+	g_clear_pointer(&priv->source, _g_usb_source_destroy);
+
+	g_usb_context_source_remove(self, &priv->hotplug_poll_id);
+	g_usb_context_source_remove(self, &priv->idle_events_id);
+	g_usb_context_source_remove(self, &priv->hotplug_debounce_id);
+	if (priv->emulate_source != NULL) {
+		g_source_destroy(priv->emulate_source);
+		g_clear_pointer(&priv->emulate_source, g_source_unref);
 	}
-
-	if (priv->hotplug_poll_id > 0) {
-		g_source_remove(priv->hotplug_poll_id);
-		priv->hotplug_poll_id = 0;
+	while (priv->replug_waiters != NULL && priv->replug_waiters->len > 0) {
+		GUsbContextReplugWaiter *waiter = g_ptr_array_index(priv->replug_waiters, 0);
+		g_ptr_array_remove_index(priv->replug_waiters, 0);
+		g_task_return_new_error(waiter->task,
+					G_IO_ERROR,
+					G_IO_ERROR_CANCELLED,
+					"context was disposed");
+		g_usb_context_replug_waiter_free(waiter);
 	}
-	if (priv->idle_events_id > 0) {
-		g_source_remove(priv->idle_events_id);
-		priv->idle_events_id = 0;
+	while (!g_queue_is_empty(&priv->emulate_queue)) {
+		GUsbContextEmulateHelper *helper = g_queue_pop_head(&priv->emulate_queue);
+		g_task_return_new_error(helper->task,
+					G_IO_ERROR,
+					G_IO_ERROR_CANCELLED,
+					"context was disposed");
+		g_usb_context_emulate_helper_free(helper);
 	}
 
 	g_clear_pointer(&priv->main_ctx, g_main_context_unref);
 	g_clear_pointer(&priv->devices, g_ptr_array_unref);
+	g_clear_pointer(&priv->devices_snapshot, g_ptr_array_unref);
 	g_clear_pointer(&priv->devices_removed, g_ptr_array_unref);
+	g_clear_pointer(&priv->dict_removed, g_hash_table_unref);
+	g_clear_pointer(&priv->devices_by_bus_address, g_hash_table_unref);
+	g_clear_pointer(&priv->devices_by_platform_id, g_hash_table_unref);
+	g_clear_pointer(&priv->devices_by_vid_pid, g_hash_table_unref);
 	g_clear_pointer(&priv->dict_usb_ids, g_hash_table_unref);
 	g_clear_pointer(&priv->dict_replug, g_hash_table_unref);
-	g_clear_pointer(&priv->ctx, libusb_exit);
+	g_clear_pointer(&priv->replug_waiters, g_ptr_array_unref);
+	g_clear_pointer(&priv->blobs, g_usb_context_blobs_unref);
+	g_clear_pointer(&priv->descriptor_cache, g_hash_table_unref);
+	g_clear_pointer(&priv->shards, g_ptr_array_unref);
+	priv->ctx = NULL;
+	g_clear_pointer(&priv->hotplug_ids, g_array_unref);
+	g_clear_pointer(&priv->match_rules, g_array_unref);
+	g_clear_pointer(&priv->enumerate_tasks, g_ptr_array_unref);
 	g_clear_pointer(&priv->idle_events, g_ptr_array_unref);
+	g_clear_pointer(&priv->idle_events_spare, g_ptr_array_unref);
+	g_clear_pointer(&priv->hotplug_debounced, g_ptr_array_unref);
+	g_clear_pointer(&priv->thread_event_name, g_free);
 	g_mutex_clear(&priv->idle_events_mutex);
+	g_mutex_clear(&priv->descriptor_cache_mutex);
+	g_mutex_clear(&priv->devices_mutex);
 
 	G_OBJECT_CLASS(g_usb_context_parent_class)->dispose(object);
 }
@@ -158,6 +510,21 @@ g_usb_context_get_property(GObject *object, guint prop_id, GValue *value, GParam
 	case PROP_DEBUG_LEVEL:
 		g_value_set_int(value, priv->debug_level);
 		break;
+	case PROP_EVENT_THREAD_NAME:
+		g_value_set_string(value, priv->thread_event_name);
+		break;
+	case PROP_EVENT_THREAD_POLICY:
+		g_value_set_uint(value, priv->thread_event_policy);
+		break;
+	case PROP_EVENT_THREAD_PRIORITY:
+		g_value_set_int(value, priv->thread_event_priority);
+		break;
+	case PROP_EVENT_THREAD_AFFINITY:
+		g_value_set_uint64(value, priv->thread_event_affinity);
+		break;
+	case PROP_EVENT_SHARDS:
+		g_value_set_uint(value, priv->event_shards);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 		break;
@@ -173,11 +540,23 @@ g_usb_context_set_property(GObject *object, guint prop_id, const GValue *value,
 	switch (prop_id) {
 	case PROP_DEBUG_LEVEL:
 		priv->debug_level = g_value_get_int(value);
-#ifdef HAVE_LIBUSB_SET_OPTION
-		libusb_set_option(priv->ctx, LIBUSB_OPTION_LOG_LEVEL, priv->debug_level);
-#else
-		libusb_set_debug(priv->ctx, priv->debug_level);
-#endif
+		g_usb_context_apply_debug_level(self);
+		break;
+	case PROP_EVENT_THREAD_NAME:
+		g_free(priv->thread_event_name);
+		priv->thread_event_name = g_value_dup_string(value);
+		break;
+	case PROP_EVENT_THREAD_POLICY:
+		priv->thread_event_policy = g_value_get_uint(value);
+		break;
+	case PROP_EVENT_THREAD_PRIORITY:
+		priv->thread_event_priority = g_value_get_int(value);
+		break;
+	case PROP_EVENT_THREAD_AFFINITY:
+		priv->thread_event_affinity = g_value_get_uint64(value);
+		break;
+	case PROP_EVENT_SHARDS:
+		priv->event_shards = g_value_get_uint(value);
 		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -206,6 +585,95 @@ g_usb_context_class_init(GUsbContextClass *klass)
 	pspecs[PROP_DEBUG_LEVEL] =
 	    g_param_spec_int("debug_level", NULL, NULL, 0, 3, 0, G_PARAM_READWRITE);
 
+	/**
+	 * GUsbContext:event_thread_name:
+	 *
+	 * The name of the libusb event thread.
+	 *
+	 * Since: 0.5.0
+	 */
+	pspecs[PROP_EVENT_THREAD_NAME] =
+	    g_param_spec_string("event_thread_name",
+				NULL,
+				NULL,
+				"GUsbEventThread",
+				G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+	/**
+	 * GUsbContext:event_thread_policy:
+	 *
+	 * The #GUsbContextThreadPolicy of the libusb event thread. The real-time policies usually
+	 * need `CAP_SYS_NICE`, and a warning is printed if they cannot be set.
+	 *
+	 * Since: 0.5.0
+	 */
+	pspecs[PROP_EVENT_THREAD_POLICY] =
+	    g_param_spec_uint("event_thread_policy",
+			      NULL,
+			      NULL,
+			      G_USB_CONTEXT_THREAD_POLICY_DEFAULT,
+			      G_USB_CONTEXT_THREAD_POLICY_RR,
+			      G_USB_CONTEXT_THREAD_POLICY_DEFAULT,
+			      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+	/**
+	 * GUsbContext:event_thread_priority:
+	 *
+	 * The real-time priority of the libusb event thread, used with
+	 * %G_USB_CONTEXT_THREAD_POLICY_FIFO and %G_USB_CONTEXT_THREAD_POLICY_RR.
+	 *
+	 * Since: 0.5.0
+	 */
+	pspecs[PROP_EVENT_THREAD_PRIORITY] =
+	    g_param_spec_int("event_thread_priority",
+			     NULL,
+			     NULL,
+			     1,
+			     99,
+			     1,
+			     G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+	/**
+	 * GUsbContext:event_thread_affinity:
+	 *
+	 * The CPUs the libusb event thread may run on, where bit N is CPU N, or 0 for any CPU.
+	 *
+	 * With more than one #GUsbContext:event_shards the same mask, policy and priority are
+	 * applied to every shard thread, so the mask should include at least as many CPUs as
+	 * there are shards for the busses to complete in parallel.
+	 *
+	 * Since: 0.5.0
+	 */
+	pspecs[PROP_EVENT_THREAD_AFFINITY] =
+	    g_param_spec_uint64("event_thread_affinity",
+				NULL,
+				NULL,
+				0,
+				G_MAXUINT64,
+				0,
+				G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
+	/**
+	 * GUsbContext:event_shards:
+	 *
+	 * The number of libusb contexts, each with its own event thread. Each USB bus is owned by
+	 * exactly one shard so that transfers on different busses complete in parallel.
+	 *
+	 * Using more than one shard costs one extra libusb context per shard, and is not
+	 * compatible with g_usb_context_get_source(). The #GUsbContext:event_thread_policy,
+	 * #GUsbContext:event_thread_priority and #GUsbContext:event_thread_affinity are applied
+	 * to each shard thread alike.
+	 *
+	 * Since: 0.5.0
+	 */
+	pspecs[PROP_EVENT_SHARDS] = g_param_spec_uint("event_shards",
+						      NULL,
+						      NULL,
+						      1,
+						      64,
+						      1,
+						      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
 	g_object_class_install_properties(object_class, N_PROPERTIES, pspecs);
 
 	/**
@@ -307,85 +775,435 @@ g_usb_context_emit_device_changed(GUsbContext *self, GUsbDevice *device)
 	g_signal_emit(self, signals[DEVICE_CHANGED_SIGNAL], 0, device);
 }
 
+#define G_USB_CONTEXT_BUS_ADDRESS_KEY(bus, addr) GUINT_TO_POINTER(((guint)(bus) << 8) | (addr))
+#define G_USB_CONTEXT_VID_PID_KEY(vid, pid)	 GUINT_TO_POINTER(((guint)(vid) << 16) | (pid))
+
+/* the values are borrowed from priv->devices, and kept in the same order */
 static void
-g_usb_context_add_device(GUsbContext *self, struct libusb_device *dev)
+g_usb_context_index_add(GHashTable *index, gpointer key, GUsbDevice *device)
 {
-	GUsbContextPrivate *priv = GET_PRIVATE(self);
-	GUsbContextReplugHelper *replug_helper;
-	const gchar *platform_id;
-	guint8 bus;
-	guint8 address;
-	g_autoptr(GError) error = NULL;
-	g_autoptr(GUsbDevice) device = NULL;
-
-	/* does any existing device exist */
-	bus = libusb_get_bus_number(dev);
-	address = libusb_get_device_address(dev);
+	GPtrArray *devices = g_hash_table_lookup(index, key);
+	if (devices == NULL) {
+		devices = g_ptr_array_new();
+		g_hash_table_insert(index, key, devices);
+	}
+	g_ptr_array_add(devices, device);
+}
 
-	if (priv->done_enumerate)
-		device = g_usb_context_find_by_bus_address(self, bus, address, NULL);
-	if (device != NULL)
+static void
+g_usb_context_index_remove(GHashTable *index, gconstpointer key, GUsbDevice *device)
+{
+	GPtrArray *devices = g_hash_table_lookup(index, key);
+	if (devices == NULL)
 		return;
+	g_ptr_array_remove(devices, device);
+	if (devices->len == 0)
+		g_hash_table_remove(index, key);
+}
 
-	/* add the device */
-	device = _g_usb_device_new(self, dev, &error);
-	if (device == NULL) {
-		g_debug("There was a problem creating the device: %s", error->message);
-		return;
-	}
+/* returns the first device added with this key, or %NULL */
+static GUsbDevice *
+g_usb_context_index_lookup(GHashTable *index, gconstpointer key)
+{
+	GPtrArray *devices = g_hash_table_lookup(index, key);
+	if (devices == NULL)
+		return NULL;
+	return g_ptr_array_index(devices, 0);
+}
 
-	/* auto-open */
-	if (priv->flags & G_USB_CONTEXT_FLAGS_AUTO_OPEN_DEVICES) {
-		if (!_g_usb_device_open_internal(device, &error)) {
-			g_warning("cannot open the device: %s", error->message);
-			return;
-		}
+static void
+g_usb_context_devices_index(GUsbContext *self, GUsbDevice *device)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	const gchar *platform_id = g_usb_device_get_platform_id(device);
+
+	g_usb_context_index_add(priv->devices_by_bus_address,
+				G_USB_CONTEXT_BUS_ADDRESS_KEY(g_usb_device_get_bus(device),
+							      g_usb_device_get_address(device)),
+				device);
+	g_usb_context_index_add(
+	    priv->devices_by_vid_pid,
+	    G_USB_CONTEXT_VID_PID_KEY(g_usb_device_get_vid(device), g_usb_device_get_pid(device)),
+	    device);
+	if (platform_id != NULL) {
+		gpointer key = g_hash_table_contains(priv->devices_by_platform_id, platform_id)
+				   ? (gpointer)platform_id
+				   : g_strdup(platform_id);
+		g_usb_context_index_add(priv->devices_by_platform_id, key, device);
 	}
+}
 
-	/* add to enumerated list */
+static void
+g_usb_context_devices_unindex(GUsbContext *self, GUsbDevice *device)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	const gchar *platform_id = g_usb_device_get_platform_id(device);
+
+	g_usb_context_index_remove(priv->devices_by_bus_address,
+				   G_USB_CONTEXT_BUS_ADDRESS_KEY(g_usb_device_get_bus(device),
+								 g_usb_device_get_address(device)),
+				   device);
+	g_usb_context_index_remove(
+	    priv->devices_by_vid_pid,
+	    G_USB_CONTEXT_VID_PID_KEY(g_usb_device_get_vid(device), g_usb_device_get_pid(device)),
+	    device);
+	if (platform_id != NULL)
+		g_usb_context_index_remove(priv->devices_by_platform_id, platform_id, device);
+}
+
+/* only the main thread changes the devices, so it can read them without holding the lock;
+ * the snapshot is dropped with the lock held and rebuilt when it is next requested, which
+ * keeps adding or removing a batch of devices linear */
+static void
+g_usb_context_devices_add(GUsbContext *self, GUsbDevice *device)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	const gchar *platform_id = g_usb_device_get_platform_id(device);
+	g_autoptr(GPtrArray) snapshot_old = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&priv->devices_mutex);
+
+	if (platform_id != NULL)
+		g_hash_table_remove(priv->dict_removed, platform_id);
 	g_ptr_array_add(priv->devices, g_object_ref(device));
+	g_usb_context_devices_index(self, device);
+	snapshot_old = g_steal_pointer(&priv->devices_snapshot);
+}
 
-	/* if we're waiting for replug, suppress the signal */
-	platform_id = g_usb_device_get_platform_id(device);
-	replug_helper = g_hash_table_lookup(priv->dict_replug, platform_id);
-	if (replug_helper != NULL) {
-		g_debug("%s is in replug, ignoring add", platform_id);
-		g_object_unref(replug_helper->device);
-		replug_helper->device = g_object_ref(device);
-		g_main_loop_quit(replug_helper->loop);
+/* the removal is recorded so that it can be included in a delta */
+static void
+g_usb_context_devices_record_removal(GUsbContext *self, GUsbDevice *device)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	const gchar *platform_id = g_usb_device_get_platform_id(device);
+	if (platform_id == NULL)
 		return;
-	}
-
-	/* emit signal */
-	g_usb_context_emit_device_add(self, device);
+	g_hash_table_insert(priv->dict_removed,
+			    g_strdup(platform_id),
+			    GUINT_TO_POINTER(_g_usb_context_next_generation(self)));
 }
 
 static void
-g_usb_context_remove_device(GUsbContext *self, struct libusb_device *dev)
+g_usb_context_devices_remove(GUsbContext *self, GUsbDevice *device)
 {
 	GUsbContextPrivate *priv = GET_PRIVATE(self);
-	GUsbContextReplugHelper *replug_helper;
-	const gchar *platform_id;
-	guint8 bus;
-	guint8 address;
-	g_autoptr(GUsbDevice) device = NULL;
+	g_autoptr(GUsbDevice) device_ref = g_object_ref(device); /* not finalized when locked */
+	g_autoptr(GPtrArray) snapshot_old = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&priv->devices_mutex);
 
-	/* does any existing device exist */
-	bus = libusb_get_bus_number(dev);
-	address = libusb_get_device_address(dev);
-	device = g_usb_context_find_by_bus_address(self, bus, address, NULL);
-	if (device == NULL) {
-		g_debug("%i:%i does not exist", bus, address);
-		return;
-	}
+	g_usb_context_devices_record_removal(self, device);
+	g_usb_context_devices_unindex(self, device);
+	g_ptr_array_remove(priv->devices, device);
+	snapshot_old = g_steal_pointer(&priv->devices_snapshot);
+}
 
-	/* save this to a lookaside */
+/* in one pass, keeping the order of the remaining devices */
+static void
+g_usb_context_devices_remove_all(GUsbContext *self, GHashTable *devices)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GPtrArray) devices_old = NULL;
+	g_autoptr(GPtrArray) snapshot_old = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&priv->devices_mutex);
+
+	devices_old = g_steal_pointer(&priv->devices);
+	priv->devices = g_ptr_array_new_full(devices_old->len, (GDestroyNotify)g_object_unref);
+	for (guint i = 0; i < devices_old->len; i++) {
+		GUsbDevice *device = g_ptr_array_index(devices_old, i);
+		if (g_hash_table_contains(devices, device)) {
+			g_usb_context_devices_record_removal(self, device);
+			g_usb_context_devices_unindex(self, device);
+			continue;
+		}
+		g_ptr_array_add(priv->devices, g_object_ref(device));
+	}
+	snapshot_old = g_steal_pointer(&priv->devices_snapshot);
+}
+
+/* no rules matches everything */
+gboolean
+_g_usb_context_match_rules_check(GUsbContext *self, guint16 vid, guint16 pid, guint8 device_class)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+
+	if (priv->match_rules->len == 0)
+		return TRUE;
+	for (guint i = 0; i < priv->match_rules->len; i++) {
+		GUsbContextMatchRule *rule =
+		    &g_array_index(priv->match_rules, GUsbContextMatchRule, i);
+		if (rule->vid != LIBUSB_HOTPLUG_MATCH_ANY && rule->vid != vid)
+			continue;
+		if (rule->pid != LIBUSB_HOTPLUG_MATCH_ANY && rule->pid != pid)
+			continue;
+		if (rule->device_class != LIBUSB_HOTPLUG_MATCH_ANY &&
+		    rule->device_class != device_class)
+			continue;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+static gboolean
+g_usb_context_match_rules(GUsbContext *self, struct libusb_device *dev)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	struct libusb_device_descriptor desc = {0};
+
+	if (priv->match_rules->len == 0)
+		return TRUE;
+	if (libusb_get_device_descriptor(dev, &desc) != LIBUSB_SUCCESS)
+		return FALSE;
+	return _g_usb_context_match_rules_check(self,
+						desc.idVendor,
+						desc.idProduct,
+						desc.bDeviceClass);
+}
+
+/* the removal was hidden while waiting, so it has to be emitted if the device never returns,
+ * but only once the last waiter for the same device has given up */
+static void
+g_usb_context_replug_waiter_fail(GUsbContextReplugWaiter *waiter, GError *error)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(waiter->self);
+	gboolean handed_over = FALSE;
+
+	g_ptr_array_remove(priv->replug_waiters, waiter);
+	if (waiter->removed) {
+		for (guint i = 0; i < priv->replug_waiters->len; i++) {
+			GUsbContextReplugWaiter *waiter_tmp =
+			    g_ptr_array_index(priv->replug_waiters, i);
+			if (waiter_tmp->device == waiter->device) {
+				waiter_tmp->removed = TRUE;
+				handed_over = TRUE;
+			}
+		}
+		if (!handed_over)
+			g_usb_context_emit_device_remove(waiter->self, waiter->device);
+	}
+	g_task_return_error(waiter->task, error);
+	g_usb_context_replug_waiter_free(waiter);
+}
+
+static gboolean
+g_usb_context_replug_waiter_matches(GUsbContextReplugWaiter *waiter, GUsbDevice *device)
+{
+	if (waiter->func != NULL)
+		return waiter->func(waiter->device, device, waiter->user_data);
+	return g_strcmp0(g_usb_device_get_platform_id(waiter->device),
+			 g_usb_device_get_platform_id(device)) == 0;
+}
+
+/* the hidden removal of @device is about to be emitted, so no other waiter has to emit it */
+static void
+g_usb_context_replug_waiters_forget_remove(GUsbContext *self, GUsbDevice *device)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	for (guint i = 0; i < priv->replug_waiters->len; i++) {
+		GUsbContextReplugWaiter *waiter = g_ptr_array_index(priv->replug_waiters, i);
+		if (waiter->device == device)
+			waiter->removed = FALSE;
+	}
+}
+
+/* returns %TRUE if any waiter was completed with @device on the same platform ID while the
+ * removal was still hidden, where the device-added signal has to be suppressed */
+static gboolean
+g_usb_context_replug_waiters_match(GUsbContext *self, GUsbDevice *device)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	const gchar *platform_id = g_usb_device_get_platform_id(device);
+	gboolean ret = FALSE;
+	g_autoptr(GPtrArray) matched = g_ptr_array_new();
+
+	/* the callbacks may add or remove waiters, so complete them after the scan */
+	for (guint i = 0; i < priv->replug_waiters->len; i++) {
+		GUsbContextReplugWaiter *waiter = g_ptr_array_index(priv->replug_waiters, i);
+		if (g_usb_context_replug_waiter_matches(waiter, device))
+			g_ptr_array_add(matched, waiter);
+	}
+	for (guint i = 0; i < matched->len; i++) {
+		GUsbContextReplugWaiter *waiter = g_ptr_array_index(matched, i);
+		g_ptr_array_remove(priv->replug_waiters, waiter);
+
+		/* the hidden removal is handled once, by the first waiter for the device, and on
+		 * another port the old platform ID is gone for good so listeners need both */
+		if (waiter->removed) {
+			const gchar *platform_id_old = g_usb_device_get_platform_id(waiter->device);
+			g_usb_context_replug_waiters_forget_remove(self, waiter->device);
+			if (g_strcmp0(platform_id_old, platform_id) == 0)
+				ret = TRUE;
+			else
+				g_usb_context_emit_device_remove(self, waiter->device);
+		}
+		g_task_return_pointer(waiter->task, g_object_ref(device), g_object_unref);
+		g_usb_context_replug_waiter_free(waiter);
+	}
+	return ret;
+}
+
+/* returns %TRUE if somebody is waiting for @device to come back */
+static gboolean
+g_usb_context_replug_waiters_remove(GUsbContext *self, GUsbDevice *device)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	const gchar *platform_id = g_usb_device_get_platform_id(device);
+	gboolean ret = FALSE;
+
+	for (guint i = 0; i < priv->replug_waiters->len; i++) {
+		GUsbContextReplugWaiter *waiter = g_ptr_array_index(priv->replug_waiters, i);
+		if (waiter->device == device ||
+		    g_strcmp0(g_usb_device_get_platform_id(waiter->device), platform_id) == 0) {
+			waiter->removed = TRUE;
+			ret = TRUE;
+		}
+	}
+	return ret;
+}
+
+/* add to the enumerated list and signal, unless somebody is waiting for it to replug */
+static void
+g_usb_context_publish_device(GUsbContext *self, GUsbDevice *device)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GUsbContextReplugHelper *replug_helper;
+	const gchar *platform_id;
+
+	/* add to enumerated list */
+	g_usb_context_devices_add(self, device);
+
+	/* if we're waiting for replug, suppress the signal */
+	platform_id = g_usb_device_get_platform_id(device);
+	replug_helper = g_hash_table_lookup(priv->dict_replug, platform_id);
+	if (replug_helper != NULL) {
+		g_debug("%s is in replug, ignoring add", platform_id);
+		g_object_unref(replug_helper->device);
+		replug_helper->device = g_object_ref(device);
+		g_main_loop_quit(replug_helper->loop);
+		return;
+	}
+	if (g_usb_context_replug_waiters_match(self, device)) {
+		g_debug("%s is in replug, ignoring add", platform_id);
+		return;
+	}
+
+	/* emit signal */
+	g_usb_context_emit_device_add(self, device);
+}
+
+static void
+g_usb_context_add_device(GUsbContext *self, struct libusb_device *dev)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	guint8 bus;
+	guint8 address;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GUsbDevice) device = NULL;
+
+	/* not interesting to the caller */
+	if (!g_usb_context_match_rules(self, dev))
+		return;
+
+	/* does any existing device exist */
+	bus = libusb_get_bus_number(dev);
+	address = libusb_get_device_address(dev);
+
+	if (priv->done_enumerate)
+		device = g_usb_context_find_by_bus_address(self, bus, address, NULL);
+	if (device != NULL)
+		return;
+
+	/* add the device */
+	device = _g_usb_device_new(self, dev, &error);
+	if (device == NULL) {
+		g_debug("There was a problem creating the device: %s", error->message);
+		return;
+	}
+
+	/* auto-open */
+	if (priv->flags & G_USB_CONTEXT_FLAGS_AUTO_OPEN_DEVICES) {
+		if (!_g_usb_device_open_internal(device, &error)) {
+			g_warning("cannot open the device: %s", error->message);
+			return;
+		}
+	}
+	g_usb_context_publish_device(self, device);
+}
+
+/* this is run in a worker thread */
+static void
+g_usb_context_open_worker_cb(gpointer data, gpointer user_data)
+{
+	GUsbContextOpenHelper *helper = (GUsbContextOpenHelper *)data;
+	if (!_g_usb_device_open_internal(helper->device, &helper->error))
+		g_prefix_error(&helper->error, "cannot open the device: ");
+}
+
+/* opening is a syscall round-trip per device, so do this concurrently and then add in order */
+static void
+g_usb_context_add_devices_parallel(GUsbContext *self, GPtrArray *devs)
+{
+	GThreadPool *pool;
+	g_autofree GUsbContextOpenHelper *helpers = g_new0(GUsbContextOpenHelper, devs->len);
+
+	/* a shared pool cannot fail to be created */
+	pool = g_thread_pool_new(g_usb_context_open_worker_cb,
+				 NULL,
+				 (gint)g_get_num_processors(),
+				 FALSE,
+				 NULL);
+	for (guint i = 0; i < devs->len; i++) {
+		struct libusb_device *dev = g_ptr_array_index(devs, i);
+		g_autoptr(GError) error = NULL;
+		if (!g_usb_context_match_rules(self, dev))
+			continue;
+		helpers[i].device = _g_usb_device_new(self, dev, &error);
+		if (helpers[i].device == NULL) {
+			g_debug("There was a problem creating the device: %s", error->message);
+			continue;
+		}
+		g_thread_pool_push(pool, &helpers[i], NULL);
+	}
+	g_thread_pool_free(pool, FALSE, TRUE);
+
+	for (guint i = 0; i < devs->len; i++) {
+		GUsbContextOpenHelper *helper = &helpers[i];
+		if (helper->device == NULL)
+			continue;
+		if (helper->error != NULL) {
+			g_warning("%s", helper->error->message);
+			g_error_free(helper->error);
+		} else {
+			g_usb_context_publish_device(self, helper->device);
+		}
+		g_object_unref(helper->device);
+	}
+}
+
+static void
+g_usb_context_remove_device(GUsbContext *self, struct libusb_device *dev)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GUsbContextReplugHelper *replug_helper;
+	const gchar *platform_id;
+	guint8 bus;
+	guint8 address;
+	g_autoptr(GUsbDevice) device = NULL;
+
+	/* does any existing device exist */
+	bus = libusb_get_bus_number(dev);
+	address = libusb_get_device_address(dev);
+	device = g_usb_context_find_by_bus_address(self, bus, address, NULL);
+	if (device == NULL) {
+		g_debug("%i:%i does not exist", bus, address);
+		return;
+	}
+
+	/* save this to a lookaside */
 	if (priv->flags & G_USB_CONTEXT_FLAGS_SAVE_EVENTS) {
 		g_ptr_array_add(priv->devices_removed, g_object_ref(device));
 	}
 
 	/* remove from enumerated list */
-	g_ptr_array_remove(priv->devices, device);
+	g_usb_context_devices_remove(self, device);
 
 	/* if we're waiting for replug, suppress the signal */
 	platform_id = g_usb_device_get_platform_id(device);
@@ -394,6 +1212,10 @@ g_usb_context_remove_device(GUsbContext *self, struct libusb_device *dev)
 		g_debug("%s is in replug, ignoring remove", platform_id);
 		return;
 	}
+	if (g_usb_context_replug_waiters_remove(self, device)) {
+		g_debug("%s is in replug, ignoring remove", platform_id);
+		return;
+	}
 
 	/* emit signal */
 	g_usb_context_emit_device_remove(self, device);
@@ -417,35 +1239,21 @@ g_usb_context_load(GUsbContext *self, JsonObject *json_object, GError **error)
 	return g_usb_context_load_with_tag(self, json_object, NULL, error);
 }
 
-/**
- * g_usb_context_load_with_tag:
- * @self: a #GUsbContext
- * @json_object: a #JsonObject
- * @tag: a string tag, e.g. `runtime-reload`, or %NULL
- * @error: a #GError, or %NULL
- *
- * Loads any devices with a specified tag into the context from a JSON object.
- *
- * Return value: %TRUE on success
- *
- * Since: 0.4.1
- **/
-gboolean
-g_usb_context_load_with_tag(GUsbContext *self,
+static gboolean
+g_usb_context_load_internal(GUsbContext *self,
 			    JsonObject *json_object,
+			    GPtrArray *blobs,
 			    const gchar *tag,
 			    GError **error)
 {
 	GUsbContextPrivate *priv = GET_PRIVATE(self);
 	JsonArray *json_array;
+	gboolean is_delta = json_object_has_member(json_object, "BaseGeneration");
+	g_autoptr(GPtrArray) blobs_json = NULL;
 	g_autoptr(GPtrArray) devices_added =
 	    g_ptr_array_new_with_free_func((GDestroyNotify)g_object_unref);
-	g_autoptr(GPtrArray) devices_remove =
-	    g_ptr_array_new_with_free_func((GDestroyNotify)g_object_unref);
-
-	g_return_val_if_fail(G_USB_IS_CONTEXT(self), FALSE);
-	g_return_val_if_fail(json_object != NULL, FALSE);
-	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	g_autoptr(GHashTable) devices_remove =
+	    g_hash_table_new_full(g_direct_hash, g_direct_equal, g_object_unref, NULL);
 
 	/* if not already set */
 	priv->done_enumerate = TRUE;
@@ -459,9 +1267,33 @@ g_usb_context_load_with_tag(GUsbContext *self,
 		return FALSE;
 	}
 
+	/* payloads shared between events */
+	if (blobs == NULL && json_object_has_member(json_object, "UsbBlobs")) {
+		json_array = json_object_get_array_member(json_object, "UsbBlobs");
+		blobs_json = g_ptr_array_new_full(json_array_get_length(json_array),
+						  (GDestroyNotify)g_bytes_unref);
+		for (guint i = 0; i < json_array_get_length(json_array); i++) {
+			const gchar *str = json_array_get_string_element(json_array, i);
+			gsize bufsz = 0;
+			g_autofree guchar *buf = NULL;
+			if (str == NULL) {
+				g_set_error(error,
+					    G_IO_ERROR,
+					    G_IO_ERROR_INVALID_DATA,
+					    "invalid UsbBlobs element %u",
+					    i);
+				return FALSE;
+			}
+			buf = g_base64_decode(str, &bufsz);
+			g_ptr_array_add(blobs_json, g_bytes_new_take(g_steal_pointer(&buf), bufsz));
+		}
+		blobs = blobs_json;
+	}
+
 	/* four steps:
 	 *
-	 * 1. store all the existing devices matching the tag in devices_remove
+	 * 1. store all the existing devices matching the tag in devices_remove, or for a delta
+	 *    only the devices that were explicitly removed
 	 * 2. read the devices in the array:
 	 *    - if the platform-id exists: replace the event data & remove from devices_remove
 	 *    - otherwise add to devices_added
@@ -470,52 +1302,85 @@ g_usb_context_load_with_tag(GUsbContext *self,
 	 */
 	for (guint i = 0; i < priv->devices->len; i++) {
 		GUsbDevice *device = g_ptr_array_index(priv->devices, i);
-		if (tag == NULL || g_usb_device_has_tag(device, tag))
-			g_ptr_array_add(devices_remove, g_object_ref(device));
+		if (!is_delta && (tag == NULL || g_usb_device_has_tag(device, tag)))
+			g_hash_table_add(devices_remove, g_object_ref(device));
+	}
+	if (is_delta && json_object_has_member(json_object, "RemovedPlatformIds")) {
+		json_array = json_object_get_array_member(json_object, "RemovedPlatformIds");
+		for (guint i = 0; i < json_array_get_length(json_array); i++) {
+			const gchar *platform_id = json_array_get_string_element(json_array, i);
+			GUsbDevice *device;
+			if (platform_id == NULL)
+				continue;
+			device = g_usb_context_index_lookup(priv->devices_by_platform_id,
+							    platform_id);
+			if (device == NULL)
+				continue;
+			if (tag == NULL || g_usb_device_has_tag(device, tag))
+				g_hash_table_add(devices_remove, g_object_ref(device));
+		}
 	}
 	json_array = json_object_get_array_member(json_object, "UsbDevices");
 	for (guint i = 0; i < json_array_get_length(json_array); i++) {
 		JsonNode *node_tmp = json_array_get_element(json_array, i);
 		JsonObject *obj_tmp = json_node_get_object(node_tmp);
-		g_autoptr(GUsbDevice) device_old = NULL;
+		GUsbDevice *device_old = NULL;
+		const gchar *platform_id;
 		g_autoptr(GUsbDevice) device_tmp =
 		    g_object_new(G_USB_TYPE_DEVICE, "context", self, NULL);
-		if (!_g_usb_device_load(device_tmp, obj_tmp, error))
+		if (!_g_usb_device_load(device_tmp, obj_tmp, blobs, error))
 			return FALSE;
 		if (tag != NULL && !g_usb_device_has_tag(device_tmp, tag))
 			continue;
 
 		/* does a device with this platform ID [and the same created date] already exist */
-		device_old =
-		    g_usb_context_find_by_platform_id(self,
-						      g_usb_device_get_platform_id(device_tmp),
-						      NULL);
+		platform_id = g_usb_device_get_platform_id(device_tmp);
+		if (platform_id != NULL)
+			device_old =
+			    g_usb_context_index_lookup(priv->devices_by_platform_id, platform_id);
 		if (device_old != NULL && g_date_time_equal(g_usb_device_get_created(device_old),
 							    g_usb_device_get_created(device_tmp))) {
-			g_autoptr(GPtrArray) events = g_usb_device_get_events(device_tmp);
-			g_usb_device_clear_events(device_old);
-			for (guint j = 0; j < events->len; j++) {
-				GUsbDeviceEvent *event = g_ptr_array_index(events, j);
-				_g_usb_device_add_event(device_old, event);
+			if (is_delta) {
+				/* the delta has everything that changed, not just the events */
+				_g_usb_device_replace_state(device_old, device_tmp);
+			} else {
+				g_autoptr(GPtrArray) events = g_usb_device_get_events(device_tmp);
+				g_usb_device_clear_events(device_old);
+				for (guint j = 0; j < events->len; j++) {
+					GUsbDeviceEvent *event = g_ptr_array_index(events, j);
+					_g_usb_device_add_event(device_old, event);
+				}
 			}
 			g_usb_context_emit_device_changed(self, device_old);
-			g_ptr_array_remove(devices_remove, device_old);
+			g_hash_table_remove(devices_remove, device_old);
 			continue;
 		}
 
+		/* replugged since the base document */
+		if (is_delta && device_old != NULL)
+			g_hash_table_add(devices_remove, g_object_ref(device_old));
+
 		/* new to us! */
 		g_ptr_array_add(devices_added, g_object_ref(device_tmp));
 	}
 
-	/* emit removes then adds */
-	for (guint i = 0; i < devices_remove->len; i++) {
-		GUsbDevice *device = g_ptr_array_index(devices_remove, i);
-		g_usb_context_emit_device_remove(self, device);
-		g_ptr_array_remove(priv->devices, device);
+	/* emit removes in the existing order, then adds, unless somebody is waiting for replug */
+	if (g_hash_table_size(devices_remove) > 0) {
+		for (guint i = 0; i < priv->devices->len; i++) {
+			GUsbDevice *device = g_ptr_array_index(priv->devices, i);
+			if (!g_hash_table_contains(devices_remove, device))
+				continue;
+			if (g_usb_context_replug_waiters_remove(self, device))
+				continue;
+			g_usb_context_emit_device_remove(self, device);
+		}
+		g_usb_context_devices_remove_all(self, devices_remove);
 	}
 	for (guint i = 0; i < devices_added->len; i++) {
 		GUsbDevice *device = g_ptr_array_index(devices_added, i);
-		g_ptr_array_add(priv->devices, g_object_ref(device));
+		g_usb_context_devices_add(self, device);
+		if (g_usb_context_replug_waiters_match(self, device))
+			continue;
 		g_usb_context_emit_device_add(self, device);
 	}
 
@@ -524,77 +1389,708 @@ g_usb_context_load_with_tag(GUsbContext *self,
 }
 
 /**
- * g_usb_context_save:
+ * g_usb_context_load_with_tag:
  * @self: a #GUsbContext
- * @json_builder: a #JsonBuilder
+ * @json_object: a #JsonObject
+ * @tag: a string tag, e.g. `runtime-reload`, or %NULL
  * @error: a #GError, or %NULL
  *
- * Saves the context to an existing JSON builder.
+ * Loads any devices with a specified tag into the context from a JSON object.
+ *
+ * If the document was created using g_usb_context_save_delta() then devices not included in the
+ * document are not removed.
+ *
+ * If the context has the %G_USB_CONTEXT_FLAGS_LAZY_LOAD flag set then only the platform ID, tags
+ * and device descriptor are parsed, and the interfaces, BOS and HID descriptors and events are
+ * only loaded when the device is first queried or opened.
  *
  * Return value: %TRUE on success
  *
- * Since: 0.4.0
+ * Since: 0.4.1
  **/
 gboolean
-g_usb_context_save(GUsbContext *self, JsonBuilder *json_builder, GError **error)
+g_usb_context_load_with_tag(GUsbContext *self,
+			    JsonObject *json_object,
+			    const gchar *tag,
+			    GError **error)
 {
-	return g_usb_context_save_with_tag(self, json_builder, NULL, error);
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), FALSE);
+	g_return_val_if_fail(json_object != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	return g_usb_context_load_internal(self, json_object, NULL, tag, error);
 }
 
 /**
- * g_usb_context_save_with_tag:
+ * g_usb_context_save:
  * @self: a #GUsbContext
  * @json_builder: a #JsonBuilder
- * @tag: a string tag, e.g. `runtime-reload`, or %NULL
  * @error: a #GError, or %NULL
  *
- * Saves any devices with a specified tag into an existing JSON builder.
+ * Saves the context to an existing JSON builder.
  *
  * Return value: %TRUE on success
  *
- * Since: 0.4.1
+ * Since: 0.4.0
  **/
 gboolean
-g_usb_context_save_with_tag(GUsbContext *self,
-			    JsonBuilder *json_builder,
-			    const gchar *tag,
-			    GError **error)
+g_usb_context_save(GUsbContext *self, JsonBuilder *json_builder, GError **error)
 {
-	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	return g_usb_context_save_with_tag(self, json_builder, NULL, error);
+}
 
-	g_return_val_if_fail(G_USB_IS_CONTEXT(self), FALSE);
-	g_return_val_if_fail(json_builder != NULL, FALSE);
-	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+/* in the order they should be saved */
+static GPtrArray *
+g_usb_context_get_devices_to_save(GUsbContext *self, const gchar *tag)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GPtrArray *devices = g_ptr_array_new_with_free_func((GDestroyNotify)g_object_unref);
 
-	/* start */
 	g_usb_context_enumerate(self);
-	json_builder_begin_object(json_builder);
-
-	/* array of devices */
-	json_builder_set_member_name(json_builder, "UsbDevices");
-	json_builder_begin_array(json_builder);
 	if (priv->flags & G_USB_CONTEXT_FLAGS_SAVE_REMOVED_DEVICES) {
 		for (guint i = 0; i < priv->devices_removed->len; i++) {
 			GUsbDevice *device = g_ptr_array_index(priv->devices_removed, i);
-			if (!_g_usb_device_save(device, json_builder, error))
-				return FALSE;
+			g_ptr_array_add(devices, g_object_ref(device));
 		}
 	}
 	for (guint i = 0; i < priv->devices->len; i++) {
 		GUsbDevice *device = g_ptr_array_index(priv->devices, i);
 		if (tag != NULL && !g_usb_device_has_tag(device, tag))
 			continue;
-		if (!_g_usb_device_save(device, json_builder, error))
-			return FALSE;
+		g_ptr_array_add(devices, g_object_ref(device));
 	}
-	json_builder_end_array(json_builder);
-
-	/* success */
-	json_builder_end_object(json_builder);
-	return TRUE;
+	return devices;
 }
 
-typedef struct {
+/* adds the UsbDevices member, where @blobs is an optional map of GBytes to blob index */
+static gboolean
+g_usb_context_save_internal(GUsbContext *self,
+			    JsonBuilder *json_builder,
+			    GHashTable *blobs,
+			    const gchar *tag,
+			    GError **error)
+{
+	g_autoptr(GPtrArray) devices = g_usb_context_get_devices_to_save(self, tag);
+
+	/* array of devices */
+	json_builder_set_member_name(json_builder, "UsbDevices");
+	json_builder_begin_array(json_builder);
+	for (guint i = 0; i < devices->len; i++) {
+		GUsbDevice *device = g_ptr_array_index(devices, i);
+		if (!_g_usb_device_save(device, json_builder, blobs, error))
+			return FALSE;
+	}
+	json_builder_end_array(json_builder);
+
+	/* success */
+	return TRUE;
+}
+
+static GHashTable *
+g_usb_context_blobs_new(void)
+{
+	return g_hash_table_new_full(g_bytes_hash,
+				     g_bytes_equal,
+				     (GDestroyNotify)g_bytes_unref,
+				     NULL);
+}
+
+/* ordered by the index allocated when saving the event */
+static GPtrArray *
+g_usb_context_blobs_to_array(GHashTable *blobs)
+{
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+	GPtrArray *array = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+
+	g_ptr_array_set_size(array, g_hash_table_size(blobs));
+	g_hash_table_iter_init(&iter, blobs);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		g_ptr_array_index(array, GPOINTER_TO_UINT(value)) = g_bytes_ref(key);
+	return array;
+}
+
+/**
+ * g_usb_context_get_generation:
+ * @self: a #GUsbContext
+ *
+ * Gets the current generation of the context, which increases every time a device is added,
+ * removed or changed.
+ *
+ * Return value: a generation number
+ *
+ * Since: 0.5.0
+ **/
+guint
+g_usb_context_get_generation(GUsbContext *self)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), 0);
+	return g_atomic_int_get(&priv->generation);
+}
+
+/* private */
+guint
+_g_usb_context_next_generation(GUsbContext *self)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	return (guint)g_atomic_int_add(&priv->generation, 1) + 1;
+}
+
+/**
+ * g_usb_context_save_delta:
+ * @self: a #GUsbContext
+ * @json_builder: a #JsonBuilder
+ * @tag: a string tag, e.g. `runtime-reload`, or %NULL
+ * @generation: a generation number, typically from g_usb_context_get_generation()
+ * @error: a #GError, or %NULL
+ *
+ * Saves only the devices with a specified tag that have changed since @generation, along with
+ * the platform IDs of any devices that have been removed. A device that has changed and no
+ * longer has @tag is listed as removed too, as it is no longer visible when loading with @tag.
+ *
+ * The `Generation` member of the document should be used as @generation for the next delta.
+ * Removals that happened before @generation are forgotten, so @generation must not decrease
+ * between calls. Loading the delta with g_usb_context_load_with_tag() applies it on top of the
+ * devices that are already loaded, replacing the tags, descriptors and events of the devices that
+ * changed.
+ *
+ * Return value: %TRUE on success
+ *
+ * Since: 0.5.0
+ **/
+gboolean
+g_usb_context_save_delta(GUsbContext *self,
+			 JsonBuilder *json_builder,
+			 const gchar *tag,
+			 guint generation,
+			 GError **error)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+	guint generation_now;
+	g_autoptr(GPtrArray) devices = NULL;
+
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), FALSE);
+	g_return_val_if_fail(json_builder != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+	/* anything changed while saving is included in the next delta */
+	generation_now = g_usb_context_get_generation(self);
+	devices = g_usb_context_get_devices_to_save(self, tag);
+
+	json_builder_begin_object(json_builder);
+	json_builder_set_member_name(json_builder, "BaseGeneration");
+	json_builder_add_int_value(json_builder, generation);
+	json_builder_set_member_name(json_builder, "Generation");
+	json_builder_add_int_value(json_builder, generation_now);
+
+	/* changed devices */
+	json_builder_set_member_name(json_builder, "UsbDevices");
+	json_builder_begin_array(json_builder);
+	for (guint i = 0; i < devices->len; i++) {
+		GUsbDevice *device = g_ptr_array_index(devices, i);
+		if (g_usb_device_get_generation(device) <= generation)
+			continue;
+		if (!_g_usb_device_save(device, json_builder, NULL, error))
+			return FALSE;
+	}
+	json_builder_end_array(json_builder);
+
+	/* removed devices */
+	json_builder_set_member_name(json_builder, "RemovedPlatformIds");
+	json_builder_begin_array(json_builder);
+	g_hash_table_iter_init(&iter, priv->dict_removed);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		if (GPOINTER_TO_UINT(value) <= generation) {
+			/* no later delta can be based on an earlier generation */
+			g_hash_table_iter_remove(&iter);
+			continue;
+		}
+		json_builder_add_string_value(json_builder, key);
+	}
+	for (guint i = 0; tag != NULL && i < priv->devices->len; i++) {
+		GUsbDevice *device = g_ptr_array_index(priv->devices, i);
+		const gchar *platform_id = g_usb_device_get_platform_id(device);
+		if (platform_id == NULL || g_usb_device_has_tag(device, tag))
+			continue;
+		if (g_usb_device_get_generation(device) <= generation)
+			continue;
+		json_builder_add_string_value(json_builder, platform_id);
+	}
+	json_builder_end_array(json_builder);
+
+	/* success */
+	json_builder_end_object(json_builder);
+	return TRUE;
+}
+
+/**
+ * g_usb_context_save_with_tag:
+ * @self: a #GUsbContext
+ * @json_builder: a #JsonBuilder
+ * @tag: a string tag, e.g. `runtime-reload`, or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Saves any devices with a specified tag into an existing JSON builder.
+ *
+ * If the context has the %G_USB_CONTEXT_FLAGS_SAVE_BLOB_TABLE flag set then identical event data
+ * is only written once into a `UsbBlobs` array, which is supported by GUsb 0.5.0 and newer.
+ *
+ * Return value: %TRUE on success
+ *
+ * Since: 0.4.1
+ **/
+gboolean
+g_usb_context_save_with_tag(GUsbContext *self,
+			    JsonBuilder *json_builder,
+			    const gchar *tag,
+			    GError **error)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GHashTable) blobs = NULL;
+
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), FALSE);
+	g_return_val_if_fail(json_builder != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+	if (priv->flags & G_USB_CONTEXT_FLAGS_SAVE_BLOB_TABLE)
+		blobs = g_usb_context_blobs_new();
+	json_builder_begin_object(json_builder);
+	if (!g_usb_context_save_internal(self, json_builder, blobs, tag, error))
+		return FALSE;
+	if (blobs != NULL && g_hash_table_size(blobs) > 0) {
+		g_autoptr(GPtrArray) array = g_usb_context_blobs_to_array(blobs);
+		json_builder_set_member_name(json_builder, "UsbBlobs");
+		json_builder_begin_array(json_builder);
+		for (guint i = 0; i < array->len; i++) {
+			GBytes *bytes = g_ptr_array_index(array, i);
+			g_autofree gchar *str = g_base64_encode(g_bytes_get_data(bytes, NULL),
+								g_bytes_get_size(bytes));
+			json_builder_add_string_value(json_builder, str);
+		}
+		json_builder_end_array(json_builder);
+	}
+	json_builder_end_object(json_builder);
+	return TRUE;
+}
+
+/**
+ * g_usb_context_load_stream:
+ * @self: a #GUsbContext
+ * @stream: a #GInputStream
+ * @tag: a string tag, e.g. `runtime-reload`, or %NULL
+ * @cancellable: a #GCancellable, or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Loads any devices with a specified tag into the context from a JSON document.
+ *
+ * If the stream starts with the gzip magic bytes then it is decompressed as it is read.
+ *
+ * The stream is read until the end, as data after the document may already have been buffered,
+ * but it is not closed.
+ *
+ * Return value: %TRUE on success
+ *
+ * Since: 0.5.0
+ **/
+gboolean
+g_usb_context_load_stream(GUsbContext *self,
+			  GInputStream *stream,
+			  const gchar *tag,
+			  GCancellable *cancellable,
+			  GError **error)
+{
+	const guint8 *buf;
+	gsize bufsz = 0;
+	GBufferedInputStream *bstream;
+	JsonNode *json_root;
+	g_autoptr(GInputStream) stream_buffered = NULL;
+	g_autoptr(GInputStream) stream_json = NULL;
+	g_autoptr(JsonParser) parser = json_parser_new();
+
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), FALSE);
+	g_return_val_if_fail(G_IS_INPUT_STREAM(stream), FALSE);
+	g_return_val_if_fail(cancellable == NULL || G_IS_CANCELLABLE(cancellable), FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+	/* look at the header without consuming it, and leave the stream open for the caller */
+	stream_buffered = g_buffered_input_stream_new(stream);
+	g_filter_input_stream_set_close_base_stream(G_FILTER_INPUT_STREAM(stream_buffered), FALSE);
+	bstream = G_BUFFERED_INPUT_STREAM(stream_buffered);
+	while (g_buffered_input_stream_get_available(bstream) < 2) {
+		gssize rc = g_buffered_input_stream_fill(bstream, -1, cancellable, error);
+		if (rc < 0)
+			return FALSE;
+		if (rc == 0)
+			break;
+	}
+	buf = g_buffered_input_stream_peek_buffer(bstream, &bufsz);
+	if (bufsz >= 2 && buf[0] == 0x1f && buf[1] == 0x8b) {
+		g_autoptr(GZlibDecompressor) decompressor =
+		    g_zlib_decompressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP);
+		stream_json =
+		    g_converter_input_stream_new(stream_buffered, G_CONVERTER(decompressor));
+	} else {
+		stream_json = g_object_ref(stream_buffered);
+	}
+
+	/* parse */
+	if (!json_parser_load_from_stream(parser, stream_json, cancellable, error))
+		return FALSE;
+	json_root = json_parser_get_root(parser);
+	if (json_root == NULL || !JSON_NODE_HOLDS_OBJECT(json_root)) {
+		g_set_error_literal(error,
+				    G_IO_ERROR,
+				    G_IO_ERROR_INVALID_DATA,
+				    "stream does not contain a JSON object");
+		return FALSE;
+	}
+	return g_usb_context_load_internal(self,
+					   json_node_get_object(json_root),
+					   NULL,
+					   tag,
+					   error);
+}
+
+/**
+ * g_usb_context_save_stream:
+ * @self: a #GUsbContext
+ * @stream: a #GOutputStream
+ * @tag: a string tag, e.g. `runtime-reload`, or %NULL
+ * @cancellable: a #GCancellable, or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Saves any devices with a specified tag as a JSON document.
+ *
+ * The document is written as each device and event is visited, rather than building the entire
+ * document in memory first.
+ *
+ * To compress the document use a #GConverterOutputStream with a #GZlibCompressor, which can be
+ * loaded again using g_usb_context_load_stream(). The stream is not closed.
+ *
+ * Return value: %TRUE on success
+ *
+ * Since: 0.5.0
+ **/
+gboolean
+g_usb_context_save_stream(GUsbContext *self,
+			  GOutputStream *stream,
+			  const gchar *tag,
+			  GCancellable *cancellable,
+			  GError **error)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GHashTable) blobs = NULL;
+	g_autoptr(GPtrArray) devices = NULL;
+
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), FALSE);
+	g_return_val_if_fail(G_IS_OUTPUT_STREAM(stream), FALSE);
+	g_return_val_if_fail(cancellable == NULL || G_IS_CANCELLABLE(cancellable), FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+	/* each device is written as it is visited */
+	if (priv->flags & G_USB_CONTEXT_FLAGS_SAVE_BLOB_TABLE)
+		blobs = g_usb_context_blobs_new();
+	devices = g_usb_context_get_devices_to_save(self, tag);
+	if (!_g_usb_json_write(stream, "{\"UsbDevices\":[", -1, cancellable, error))
+		return FALSE;
+	for (guint i = 0; i < devices->len; i++) {
+		GUsbDevice *device = g_ptr_array_index(devices, i);
+		if (i > 0 && !_g_usb_json_write(stream, ",", -1, cancellable, error))
+			return FALSE;
+		if (!_g_usb_device_save_stream(device, stream, blobs, cancellable, error))
+			return FALSE;
+	}
+	if (!_g_usb_json_write(stream, "]", -1, cancellable, error))
+		return FALSE;
+
+	/* the blob table is only known once all the events have been visited */
+	if (blobs != NULL && g_hash_table_size(blobs) > 0) {
+		g_autoptr(GPtrArray) array = g_usb_context_blobs_to_array(blobs);
+		if (!_g_usb_json_write(stream, ",\"UsbBlobs\":[", -1, cancellable, error))
+			return FALSE;
+		for (guint i = 0; i < array->len; i++) {
+			GBytes *bytes = g_ptr_array_index(array, i);
+			g_autofree gchar *b64 = g_base64_encode(g_bytes_get_data(bytes, NULL),
+								g_bytes_get_size(bytes));
+			g_autofree gchar *str = g_strdup_printf("%s\"%s\"", i > 0 ? "," : "", b64);
+			if (!_g_usb_json_write(stream, str, -1, cancellable, error))
+				return FALSE;
+		}
+		if (!_g_usb_json_write(stream, "]", -1, cancellable, error))
+			return FALSE;
+	}
+	return _g_usb_json_write(stream, "}", -1, cancellable, error);
+}
+
+/*
+ * The archive is a little-endian container that can be mapped into memory:
+ *
+ *  - header: magic, version, number of blobs, offsets of the blob table and JSON
+ *  - blob table: a 64 bit offset and size for each blob
+ *  - JSON: the normal document, where event data is a "DataRef" into the blob table
+ *  - blobs: the unique raw payloads, referenced in-place when loading
+ */
+#define G_USB_CONTEXT_ARCHIVE_MAGIC	  "GUSBARCH"
+#define G_USB_CONTEXT_ARCHIVE_VERSION	  1
+#define G_USB_CONTEXT_ARCHIVE_HEADER_SIZE 40
+#define G_USB_CONTEXT_ARCHIVE_ENTRY_SIZE  16
+
+static guint32
+g_usb_context_archive_read_uint32(const guint8 *buf)
+{
+	guint32 tmp;
+	memcpy(&tmp, buf, sizeof(tmp));
+	return GUINT32_FROM_LE(tmp);
+}
+
+static guint64
+g_usb_context_archive_read_uint64(const guint8 *buf)
+{
+	guint64 tmp;
+	memcpy(&tmp, buf, sizeof(tmp));
+	return GUINT64_FROM_LE(tmp);
+}
+
+static void
+g_usb_context_archive_append_uint32(GByteArray *buf, guint32 val)
+{
+	guint32 tmp = GUINT32_TO_LE(val);
+	g_byte_array_append(buf, (const guint8 *)&tmp, sizeof(tmp));
+}
+
+static void
+g_usb_context_archive_append_uint64(GByteArray *buf, guint64 val)
+{
+	guint64 tmp = GUINT64_TO_LE(val);
+	g_byte_array_append(buf, (const guint8 *)&tmp, sizeof(tmp));
+}
+
+static gboolean
+g_usb_context_archive_check_range(gsize bufsz, guint64 offset, guint64 size, GError **error)
+{
+	if (offset > bufsz || size > bufsz - offset) {
+		g_set_error(error,
+			    G_IO_ERROR,
+			    G_IO_ERROR_INVALID_DATA,
+			    "archive section 0x%" G_GINT64_MODIFIER "x+0x%" G_GINT64_MODIFIER
+			    "x is outside of file size 0x%" G_GSIZE_MODIFIER "x",
+			    offset,
+			    size,
+			    bufsz);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * g_usb_context_load_archive:
+ * @self: a #GUsbContext
+ * @filename: a filename created with g_usb_context_save_archive()
+ * @tag: a string tag, e.g. `runtime-reload`, or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Loads any devices with a specified tag into the context from a binary archive.
+ *
+ * The file is mapped into memory and the event data is not copied, which makes this much
+ * faster than g_usb_context_load_with_tag() for large emulation captures.
+ *
+ * Return value: %TRUE on success
+ *
+ * Since: 0.5.0
+ **/
+gboolean
+g_usb_context_load_archive(GUsbContext *self,
+			   const gchar *filename,
+			   const gchar *tag,
+			   GError **error)
+{
+	const guint8 *buf;
+	gsize bufsz = 0;
+	guint32 n_blobs;
+	guint64 json_offset;
+	guint64 json_size;
+	guint64 table_offset;
+	JsonNode *json_root;
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GMappedFile) mapped_file = NULL;
+	g_autoptr(GPtrArray) blobs = NULL;
+	g_autoptr(JsonParser) parser = json_parser_new();
+
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), FALSE);
+	g_return_val_if_fail(filename != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+	/* the blobs keep a reference to the mapping */
+	mapped_file = g_mapped_file_new(filename, FALSE, error);
+	if (mapped_file == NULL)
+		return FALSE;
+	blob = g_mapped_file_get_bytes(mapped_file);
+	buf = g_bytes_get_data(blob, &bufsz);
+
+	/* header */
+	if (bufsz < G_USB_CONTEXT_ARCHIVE_HEADER_SIZE ||
+	    memcmp(buf, G_USB_CONTEXT_ARCHIVE_MAGIC, 8) != 0) {
+		g_set_error(error,
+			    G_IO_ERROR,
+			    G_IO_ERROR_INVALID_DATA,
+			    "%s is not a GUsb archive",
+			    filename);
+		return FALSE;
+	}
+	if (g_usb_context_archive_read_uint32(buf + 8) != G_USB_CONTEXT_ARCHIVE_VERSION) {
+		g_set_error(error,
+			    G_IO_ERROR,
+			    G_IO_ERROR_NOT_SUPPORTED,
+			    "GUsb archive version %u is not supported",
+			    g_usb_context_archive_read_uint32(buf + 8));
+		return FALSE;
+	}
+	n_blobs = g_usb_context_archive_read_uint32(buf + 12);
+	json_offset = g_usb_context_archive_read_uint64(buf + 16);
+	json_size = g_usb_context_archive_read_uint64(buf + 24);
+	table_offset = g_usb_context_archive_read_uint64(buf + 32);
+
+	/* blob table */
+	if (!g_usb_context_archive_check_range(bufsz,
+					       table_offset,
+					       (guint64)n_blobs * G_USB_CONTEXT_ARCHIVE_ENTRY_SIZE,
+					       error))
+		return FALSE;
+	blobs = g_ptr_array_new_full(n_blobs, (GDestroyNotify)g_bytes_unref);
+	for (guint i = 0; i < n_blobs; i++) {
+		const guint8 *entry = buf + table_offset + (i * G_USB_CONTEXT_ARCHIVE_ENTRY_SIZE);
+		guint64 offset = g_usb_context_archive_read_uint64(entry);
+		guint64 size = g_usb_context_archive_read_uint64(entry + 8);
+		if (!g_usb_context_archive_check_range(bufsz, offset, size, error))
+			return FALSE;
+		g_ptr_array_add(blobs, g_bytes_new_from_bytes(blob, offset, size));
+	}
+
+	/* JSON */
+	if (!g_usb_context_archive_check_range(bufsz, json_offset, json_size, error))
+		return FALSE;
+	if (!json_parser_load_from_data(parser,
+					(const gchar *)buf + json_offset,
+					(gssize)json_size,
+					error))
+		return FALSE;
+	json_root = json_parser_get_root(parser);
+	if (json_root == NULL || !JSON_NODE_HOLDS_OBJECT(json_root)) {
+		g_set_error_literal(error,
+				    G_IO_ERROR,
+				    G_IO_ERROR_INVALID_DATA,
+				    "archive does not contain a JSON object");
+		return FALSE;
+	}
+	return g_usb_context_load_internal(self,
+					   json_node_get_object(json_root),
+					   blobs,
+					   tag,
+					   error);
+}
+
+/**
+ * g_usb_context_save_archive:
+ * @self: a #GUsbContext
+ * @filename: a filename
+ * @tag: a string tag, e.g. `runtime-reload`, or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Saves any devices with a specified tag into a binary archive that can be loaded using
+ * g_usb_context_load_archive().
+ *
+ * Return value: %TRUE on success
+ *
+ * Since: 0.5.0
+ **/
+gboolean
+g_usb_context_save_archive(GUsbContext *self,
+			   const gchar *filename,
+			   const gchar *tag,
+			   GError **error)
+{
+	gsize json_size = 0;
+	guint64 offset;
+	g_autofree gchar *json = NULL;
+	g_autoptr(GByteArray) buf = g_byte_array_new();
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(GFileOutputStream) ostream = NULL;
+	g_autoptr(GHashTable) blobs_dict = g_usb_context_blobs_new();
+	g_autoptr(GPtrArray) blobs = NULL;
+	g_autoptr(JsonBuilder) json_builder = json_builder_new();
+	g_autoptr(JsonGenerator) json_generator = json_generator_new();
+	g_autoptr(JsonNode) json_root = NULL;
+
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), FALSE);
+	g_return_val_if_fail(filename != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+	/* the event data is collected rather than encoded */
+	json_builder_begin_object(json_builder);
+	if (!g_usb_context_save_internal(self, json_builder, blobs_dict, tag, error))
+		return FALSE;
+	json_builder_end_object(json_builder);
+	blobs = g_usb_context_blobs_to_array(blobs_dict);
+	json_root = json_builder_get_root(json_builder);
+	json_generator_set_root(json_generator, json_root);
+	json = json_generator_to_data(json_generator, &json_size);
+
+	/* header */
+	offset = G_USB_CONTEXT_ARCHIVE_HEADER_SIZE;
+	g_byte_array_append(buf, (const guint8 *)G_USB_CONTEXT_ARCHIVE_MAGIC, 8);
+	g_usb_context_archive_append_uint32(buf, G_USB_CONTEXT_ARCHIVE_VERSION);
+	g_usb_context_archive_append_uint32(buf, blobs->len);
+	g_usb_context_archive_append_uint64(buf,
+					    offset + blobs->len * G_USB_CONTEXT_ARCHIVE_ENTRY_SIZE);
+	g_usb_context_archive_append_uint64(buf, json_size);
+	g_usb_context_archive_append_uint64(buf, offset);
+
+	/* blob table, with the blobs following the JSON */
+	offset += blobs->len * G_USB_CONTEXT_ARCHIVE_ENTRY_SIZE + json_size;
+	for (guint i = 0; i < blobs->len; i++) {
+		GBytes *bytes = g_ptr_array_index(blobs, i);
+		g_usb_context_archive_append_uint64(buf, offset);
+		g_usb_context_archive_append_uint64(buf, g_bytes_get_size(bytes));
+		offset += g_bytes_get_size(bytes);
+	}
+
+	/* write each section without joining them */
+	file = g_file_new_for_path(filename);
+	ostream = g_file_replace(file, NULL, FALSE, G_FILE_CREATE_REPLACE_DESTINATION, NULL, error);
+	if (ostream == NULL)
+		return FALSE;
+	if (!g_output_stream_write_all(G_OUTPUT_STREAM(ostream),
+				       buf->data,
+				       buf->len,
+				       NULL,
+				       NULL,
+				       error))
+		return FALSE;
+	if (!g_output_stream_write_all(G_OUTPUT_STREAM(ostream),
+				       json,
+				       json_size,
+				       NULL,
+				       NULL,
+				       error))
+		return FALSE;
+	for (guint i = 0; i < blobs->len; i++) {
+		GBytes *bytes = g_ptr_array_index(blobs, i);
+		if (!g_output_stream_write_all(G_OUTPUT_STREAM(ostream),
+					       g_bytes_get_data(bytes, NULL),
+					       g_bytes_get_size(bytes),
+					       NULL,
+					       NULL,
+					       error))
+			return FALSE;
+	}
+	return g_output_stream_close(G_OUTPUT_STREAM(ostream), NULL, error);
+}
+
+typedef struct {
 	GUsbContext *self;
 	libusb_device *dev;
 	libusb_hotplug_event event;
@@ -608,15 +2104,108 @@ g_usb_context_idle_helper_free(GUsbContextIdleHelper *helper)
 	g_free(helper);
 }
 
-static gpointer
-g_usb_context_idle_helper_copy(gconstpointer src, gpointer user_data)
+/* always in the main thread */
+static void
+g_usb_context_hotplug_dispatch(GUsbContext *self, GPtrArray *idle_events)
+{
+	for (guint i = 0; i < idle_events->len; i++) {
+		GUsbContextIdleHelper *helper = g_ptr_array_index(idle_events, i);
+		switch (helper->event) {
+		case LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED:
+			g_usb_context_add_device(helper->self, helper->dev);
+			break;
+		case LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT:
+			g_usb_context_remove_device(helper->self, helper->dev);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/* private: pairs each LEFT with the last unpaired ARRIVED for the same key */
+guint
+_g_usb_context_hotplug_collapse(const guint *keys,
+				const libusb_hotplug_event *events,
+				guint n_events,
+				gboolean *dropped)
+{
+	guint collapsed = 0;
+	g_autoptr(GHashTable) arrived = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	for (guint i = 0; i < n_events; i++) {
+		gpointer key = GUINT_TO_POINTER(keys[i]);
+		gpointer idx = NULL;
+
+		if (events[i] == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+			g_hash_table_insert(arrived, key, GUINT_TO_POINTER(i));
+			continue;
+		}
+		if (events[i] != LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT ||
+		    !g_hash_table_lookup_extended(arrived, key, NULL, &idx))
+			continue;
+		g_hash_table_remove(arrived, key);
+		dropped[GPOINTER_TO_UINT(idx)] = TRUE;
+		dropped[i] = TRUE;
+		collapsed++;
+	}
+	return collapsed;
+}
+
+/* private: how long to wait for the window to go quiet, or 0 to flush now */
+guint
+_g_usb_context_hotplug_debounce_timeout(guint debounce, guint64 held_ms)
+{
+	guint64 held_max = (guint64)debounce * G_USB_CONTEXT_HOTPLUG_DEBOUNCE_MAX;
+	if (held_ms >= held_max)
+		return 0;
+	return MIN(debounce, held_max - held_ms);
+}
+
+/* a device that arrives and leaves again within the window is never added */
+static void
+g_usb_context_hotplug_debounce_flush(GUsbContext *self)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	guint collapsed;
+	g_autoptr(GPtrArray) idle_events = priv->hotplug_debounced;
+	g_autoptr(GPtrArray) idle_events_net = g_ptr_array_new();
+	g_autofree guint *keys = g_new0(guint, idle_events->len);
+	g_autofree libusb_hotplug_event *events = g_new0(libusb_hotplug_event, idle_events->len);
+	g_autofree gboolean *dropped = g_new0(gboolean, idle_events->len);
+
+	priv->hotplug_debounced =
+	    g_ptr_array_new_with_free_func((GDestroyNotify)g_usb_context_idle_helper_free);
+	g_usb_context_source_remove(self, &priv->hotplug_debounce_id);
+
+	for (guint i = 0; i < idle_events->len; i++) {
+		GUsbContextIdleHelper *helper = g_ptr_array_index(idle_events, i);
+		keys[i] = GPOINTER_TO_UINT(
+		    G_USB_CONTEXT_BUS_ADDRESS_KEY(libusb_get_bus_number(helper->dev),
+						  libusb_get_device_address(helper->dev)));
+		events[i] = helper->event;
+	}
+	collapsed = _g_usb_context_hotplug_collapse(keys, events, idle_events->len, dropped);
+	if (collapsed > 0 && _g_usb_context_has_flag(self, G_USB_CONTEXT_FLAGS_DEBUG))
+		g_debug("collapsed %u hotplug add and remove pairs", collapsed);
+
+	for (guint i = 0; i < idle_events->len; i++) {
+		if (!dropped[i])
+			g_ptr_array_add(idle_events_net, g_ptr_array_index(idle_events, i));
+	}
+	g_usb_context_hotplug_dispatch(self, idle_events_net);
+}
+
+static gboolean
+g_usb_context_hotplug_debounce_cb(gpointer user_data)
 {
-	GUsbContextIdleHelper *helper_src = (GUsbContextIdleHelper *)src;
-	GUsbContextIdleHelper *helper_dst = g_new0(GUsbContextIdleHelper, 1);
-	helper_dst->self = g_object_ref(helper_src->self);
-	helper_dst->dev = libusb_ref_device(helper_src->dev);
-	helper_dst->event = helper_src->event;
-	return helper_dst;
+	GUsbContext *self = G_USB_CONTEXT(user_data);
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+
+	/* the source is destroyed by returning */
+	priv->hotplug_debounce_id = 0;
+	g_usb_context_hotplug_debounce_flush(self);
+	return G_SOURCE_REMOVE;
 }
 
 /* always in the main thread */
@@ -625,34 +2214,93 @@ g_usb_context_idle_hotplug_cb(gpointer user_data)
 {
 	GUsbContext *self = G_USB_CONTEXT(user_data);
 	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GUsbContext) self_ref = g_object_ref(self); /* helpers may hold the last ref */
 	g_autoptr(GPtrArray) idle_events = NULL;
 
-	/* drain the idle events with the lock held */
+	/* a nested main loop in a signal handler can run this while the spare is in use */
+	if (priv->idle_events_spare == NULL) {
+		priv->idle_events_spare =
+		    g_ptr_array_new_with_free_func((GDestroyNotify)g_usb_context_idle_helper_free);
+	}
+
+	/* swap in the empty spare with the lock held, so that nothing is copied */
 	g_mutex_lock(&priv->idle_events_mutex);
-	idle_events = g_ptr_array_copy(priv->idle_events, g_usb_context_idle_helper_copy, NULL);
-	g_ptr_array_set_size(priv->idle_events, 0);
+	idle_events = priv->idle_events;
+	priv->idle_events = g_steal_pointer(&priv->idle_events_spare);
 	priv->idle_events_id = 0;
 	g_mutex_unlock(&priv->idle_events_mutex);
 
-	/* run the callbacks when not locked */
-	for (guint i = 0; i < idle_events->len; i++) {
-		GUsbContextIdleHelper *helper = g_ptr_array_index(idle_events, i);
-		switch (helper->event) {
-		case LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED:
-			g_usb_context_add_device(helper->self, helper->dev);
-			break;
-		case LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT:
-			g_usb_context_remove_device(helper->self, helper->dev);
-			break;
-		default:
-			break;
+	/* hold back until no event has arrived for the whole window, and if the window was
+	 * disabled while events were held then dispatch those first to keep the order */
+	if (priv->hotplug_debounce > 0 || priv->hotplug_debounced->len > 0) {
+		guint timeout;
+		if (priv->hotplug_debounced->len == 0)
+			priv->hotplug_debounce_started = g_get_monotonic_time();
+		g_ptr_array_set_free_func(idle_events, NULL);
+		for (guint i = 0; i < idle_events->len; i++)
+			g_ptr_array_add(priv->hotplug_debounced, g_ptr_array_index(idle_events, i));
+		g_ptr_array_set_size(idle_events, 0);
+		g_ptr_array_set_free_func(idle_events,
+					  (GDestroyNotify)g_usb_context_idle_helper_free);
+
+		/* a continuous storm is still flushed once the first event has been held for
+		 * several windows */
+		timeout = _g_usb_context_hotplug_debounce_timeout(
+		    priv->hotplug_debounce,
+		    (g_get_monotonic_time() - priv->hotplug_debounce_started) / 1000);
+		if (timeout == 0) {
+			g_usb_context_hotplug_debounce_flush(self);
+		} else {
+			GSourceFunc func = g_usb_context_hotplug_debounce_cb;
+			g_usb_context_source_remove(self, &priv->hotplug_debounce_id);
+			priv->hotplug_debounce_id = g_usb_context_source_add(self, timeout, func);
 		}
+	} else {
+		/* run the callbacks when not locked */
+		g_usb_context_hotplug_dispatch(self, idle_events);
+		g_ptr_array_set_size(idle_events, 0);
 	}
 
+	/* keep the allocation for the next swap */
+	if (priv->idle_events_spare == NULL)
+		priv->idle_events_spare = g_steal_pointer(&idle_events);
+
 	/* all done */
 	return FALSE;
 }
 
+/* this may be run in any of the libusb threads */
+static gboolean
+g_usb_context_shard_owns(GUsbContext *self, libusb_context *ctx, libusb_device *dev)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	guint idx = libusb_get_bus_number(dev) % priv->shards->len;
+	GUsbContextShard *shard = g_ptr_array_index(priv->shards, idx);
+	return shard->ctx == ctx;
+}
+
+/* devices from the libusb context of the shard that owns their bus */
+static GPtrArray *
+g_usb_context_get_device_list(GUsbContext *self)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GPtrArray *dev_list = g_ptr_array_new_with_free_func((GDestroyNotify)libusb_unref_device);
+
+	for (guint i = 0; i < priv->shards->len; i++) {
+		GUsbContextShard *shard = g_ptr_array_index(priv->shards, i);
+		libusb_device **devs = NULL;
+
+		if (libusb_get_device_list(shard->ctx, &devs) < 0)
+			continue;
+		for (guint j = 0; devs[j] != NULL; j++) {
+			if (g_usb_context_shard_owns(self, shard->ctx, devs[j]))
+				g_ptr_array_add(dev_list, libusb_ref_device(devs[j]));
+		}
+		libusb_free_device_list(devs, 1);
+	}
+	return dev_list;
+}
+
 /* this is run in the libusb thread */
 static int LIBUSB_CALL
 g_usb_context_hotplug_cb(struct libusb_context *ctx,
@@ -671,55 +2319,108 @@ g_usb_context_hotplug_cb(struct libusb_context *ctx,
 	if (!priv->done_enumerate)
 		return 0;
 
+	/* every shard sees every device, but only the owner creates it */
+	if (!g_usb_context_shard_owns(self, ctx, dev))
+		return 0;
+
 	helper = g_new0(GUsbContextIdleHelper, 1);
 	helper->self = g_object_ref(self);
 	helper->dev = libusb_ref_device(dev);
 	helper->event = event;
 
 	g_ptr_array_add(priv->idle_events, helper);
-	if (priv->idle_events_id == 0)
-		priv->idle_events_id = g_idle_add(g_usb_context_idle_hotplug_cb, self);
+	if (priv->idle_events_id == 0) {
+		priv->idle_events_id =
+		    g_usb_context_source_add(self, 0, g_usb_context_idle_hotplug_cb);
+	}
 
 	return 0;
 }
 
 static void
-g_usb_context_rescan(GUsbContext *self)
+g_usb_context_hotplug_register(GUsbContext *self, gint vid, gint pid, gint device_class)
 {
 	GUsbContextPrivate *priv = GET_PRIVATE(self);
-	libusb_device **dev_list = NULL;
-	g_autoptr(GList) existing_devices = NULL;
 
-	/* copy to a context so we can remove from the array */
+	if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+		return;
+	for (guint i = 0; i < priv->shards->len; i++) {
+		GUsbContextShard *shard = g_ptr_array_index(priv->shards, i);
+		GUsbContextHotplugId id = {.ctx = shard->ctx};
+		gint rc = libusb_hotplug_register_callback(shard->ctx,
+							   LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+							       LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+							   0,
+							   vid,
+							   pid,
+							   device_class,
+							   g_usb_context_hotplug_cb,
+							   self,
+							   &id.handle);
+		if (rc != LIBUSB_SUCCESS) {
+			g_warning("Error creating a hotplug callback: %s", g_usb_strerror(rc));
+			continue;
+		}
+		g_array_append_val(priv->hotplug_ids, id);
+	}
+}
+
+/* keyed on the bus and address so that this is linear in the number of devices */
+static void
+g_usb_context_rescan_diff(GUsbContext *self,
+			  GPtrArray *dev_list,
+			  GPtrArray *added,
+			  GPtrArray *removed)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GHashTable) present = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	for (guint i = 0; i < dev_list->len; i++) {
+		libusb_device *dev = g_ptr_array_index(dev_list, i);
+		gpointer key = G_USB_CONTEXT_BUS_ADDRESS_KEY(libusb_get_bus_number(dev),
+							     libusb_get_device_address(dev));
+		g_hash_table_add(present, key);
+		if (!g_hash_table_contains(priv->devices_by_bus_address, key))
+			g_ptr_array_add(added, dev);
+	}
 	for (guint i = 0; i < priv->devices->len; i++) {
 		GUsbDevice *device = g_ptr_array_index(priv->devices, i);
-		existing_devices = g_list_prepend(existing_devices, device);
+		gpointer key = G_USB_CONTEXT_BUS_ADDRESS_KEY(g_usb_device_get_bus(device),
+							     g_usb_device_get_address(device));
+		if (!g_hash_table_contains(present, key))
+			g_ptr_array_add(removed, g_object_ref(device));
 	}
+}
+
+static void
+g_usb_context_rescan(GUsbContext *self)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GPtrArray) dev_list = g_usb_context_get_device_list(self);
+	g_autoptr(GPtrArray) added = g_ptr_array_new();
+	g_autoptr(GPtrArray) removed =
+	    g_ptr_array_new_with_free_func((GDestroyNotify)g_object_unref);
+
+	g_usb_context_rescan_diff(self, dev_list, added, removed);
+	if (_g_usb_context_has_flag(self, G_USB_CONTEXT_FLAGS_DEBUG) &&
+	    (added->len > 0 || removed->len > 0))
+		g_debug("rescan found %u added and %u removed devices", added->len, removed->len);
 
 	/* look for any removed devices */
-	libusb_get_device_list(priv->ctx, &dev_list);
-	for (GList *l = existing_devices; l != NULL; l = l->next) {
-		GUsbDevice *device = G_USB_DEVICE(l->data);
-		gboolean found = FALSE;
-		for (guint i = 0; dev_list != NULL && dev_list[i] != NULL; i++) {
-			if (libusb_get_bus_number(dev_list[i]) == g_usb_device_get_bus(device) &&
-			    libusb_get_device_address(dev_list[i]) ==
-				g_usb_device_get_address(device)) {
-				found = TRUE;
-				break;
-			}
-		}
-		if (!found) {
-			g_usb_context_emit_device_remove(self, device);
-			g_ptr_array_remove(priv->devices, device);
-		}
+	for (guint i = 0; i < removed->len; i++) {
+		GUsbDevice *device = g_ptr_array_index(removed, i);
+		g_usb_context_emit_device_remove(self, device);
+		g_usb_context_devices_remove(self, device);
 	}
 
-	/* add any devices not yet added (duplicates will be filtered */
-	for (guint i = 0; dev_list != NULL && dev_list[i] != NULL; i++)
-		g_usb_context_add_device(self, dev_list[i]);
-
-	libusb_free_device_list(dev_list, 1);
+	/* add any devices not yet added */
+	if (!priv->done_enumerate && priv->flags & G_USB_CONTEXT_FLAGS_AUTO_OPEN_DEVICES &&
+	    added->len > 1) {
+		g_usb_context_add_devices_parallel(self, added);
+	} else {
+		for (guint i = 0; i < added->len; i++)
+			g_usb_context_add_device(self, g_ptr_array_index(added, i));
+	}
 }
 
 static gboolean
@@ -730,6 +2431,103 @@ g_usb_context_rescan_cb(gpointer user_data)
 	return TRUE;
 }
 
+/* always in the main thread */
+static gboolean
+g_usb_context_emulate_cb(gpointer user_data)
+{
+	GUsbContext *self = G_USB_CONTEXT(user_data);
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	guint n_pending = g_queue_get_length(&priv->emulate_queue);
+
+	/* only complete the transfers that were queued before this dispatch, so that
+	 * a callback that submits another transfer is not completed re-entrantly */
+	if (priv->emulate_concurrency > 0)
+		n_pending = MIN(n_pending, priv->emulate_concurrency);
+	for (guint i = 0; i < n_pending; i++) {
+		GUsbContextEmulateHelper *helper = g_queue_pop_head(&priv->emulate_queue);
+		if (!g_task_return_error_if_cancelled(helper->task))
+			helper->func(helper->task);
+		g_usb_context_emulate_helper_free(helper);
+	}
+
+	/* more to do in the next iteration */
+	if (!g_queue_is_empty(&priv->emulate_queue))
+		return G_SOURCE_CONTINUE;
+	g_clear_pointer(&priv->emulate_source, g_source_unref);
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * _g_usb_context_emulate_task:
+ * @self: a #GUsbContext
+ * @task: a #GTask
+ * @func: the function that returns the task result
+ *
+ * Schedules an emulated transfer to be completed from an idle source on the
+ * #GMainContext, rather than returning the result before the async function
+ * has returned to the caller.
+ *
+ * Since: 0.5.0
+ **/
+void
+_g_usb_context_emulate_task(GUsbContext *self, GTask *task, GUsbContextEmulateFunc func)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GUsbContextEmulateHelper *helper = g_new0(GUsbContextEmulateHelper, 1);
+
+	helper->task = g_object_ref(task);
+	helper->func = func;
+	g_queue_push_tail(&priv->emulate_queue, helper);
+
+	/* already scheduled */
+	if (priv->emulate_source != NULL)
+		return;
+	priv->emulate_source = g_idle_source_new();
+	g_source_set_callback(priv->emulate_source, g_usb_context_emulate_cb, self, NULL);
+	g_source_attach(priv->emulate_source, priv->main_ctx);
+}
+
+/**
+ * g_usb_context_get_emulation_concurrency:
+ * @self: a #GUsbContext
+ *
+ * Gets the number of emulated transfers that are completed in each iteration
+ * of the #GMainContext.
+ *
+ * Return value: number of transfers, or 0 for no limit
+ *
+ * Since: 0.5.0
+ **/
+guint
+g_usb_context_get_emulation_concurrency(GUsbContext *self)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), 0);
+	return priv->emulate_concurrency;
+}
+
+/**
+ * g_usb_context_set_emulation_concurrency:
+ * @self: a #GUsbContext
+ * @emulation_concurrency: number of transfers, or 0 for no limit
+ *
+ * Sets the number of emulated transfers that are completed in each iteration
+ * of the #GMainContext. Emulated transfers are never completed before the
+ * async function has returned, and setting this to a low value makes the
+ * completion order of concurrent transfers closer to that of real hardware.
+ *
+ * This defaults to 0, where all the pending transfers are completed together.
+ *
+ * Since: 0.5.0
+ **/
+void
+g_usb_context_set_emulation_concurrency(GUsbContext *self, guint emulation_concurrency)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_return_if_fail(G_USB_IS_CONTEXT(self));
+	priv->emulate_concurrency = emulation_concurrency;
+}
+
 /**
  * g_usb_context_get_main_context:
  * @self: a #GUsbContext
@@ -749,11 +2547,26 @@ g_usb_context_get_main_context(GUsbContext *self)
 	return priv->main_ctx;
 }
 
+static void
+g_usb_context_ensure_rescan_timeout(GUsbContext *self)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+
+	g_usb_context_source_remove(self, &priv->hotplug_poll_id);
+	if (priv->hotplug_poll_interval > 0) {
+		priv->hotplug_poll_id = g_usb_context_source_add(self,
+								 priv->hotplug_poll_interval,
+								 g_usb_context_rescan_cb);
+	}
+}
+
 /**
  * g_usb_context_set_main_context:
  * @self: a #GUsbContext
  *
- * Sets the internal GMainContext to use for synchronous methods.
+ * Sets the internal GMainContext to use for synchronous methods. Hotplug events, the rescan
+ * timeout and emulated transfers are also dispatched in this context, and any that are pending
+ * are moved to the new context.
  *
  * Since: 0.2.5
  **/
@@ -761,27 +2574,46 @@ void
 g_usb_context_set_main_context(GUsbContext *self, GMainContext *main_ctx)
 {
 	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	gboolean idle_pending;
+	gboolean debounce_pending;
+	gboolean poll_pending;
+	g_autoptr(GMutexLocker) locker = NULL;
 
 	g_return_if_fail(G_USB_IS_CONTEXT(self));
 
-	if (main_ctx != priv->main_ctx) {
-		g_main_context_unref(priv->main_ctx);
-		priv->main_ctx = g_main_context_ref(main_ctx);
-	}
-}
-
-static void
-g_usb_context_ensure_rescan_timeout(GUsbContext *self)
-{
-	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	if (main_ctx == priv->main_ctx)
+		return;
 
-	if (priv->hotplug_poll_id > 0) {
-		g_source_remove(priv->hotplug_poll_id);
-		priv->hotplug_poll_id = 0;
+	/* the lock stops an event thread adding the hotplug idle to the old context */
+	locker = g_mutex_locker_new(&priv->idle_events_mutex);
+	idle_pending = priv->idle_events_id > 0;
+	debounce_pending = priv->hotplug_debounce_id > 0;
+	poll_pending = priv->hotplug_poll_id > 0;
+	g_usb_context_source_remove(self, &priv->idle_events_id);
+	g_usb_context_source_remove(self, &priv->hotplug_debounce_id);
+	g_usb_context_source_remove(self, &priv->hotplug_poll_id);
+	if (priv->emulate_source != NULL)
+		g_source_destroy(priv->emulate_source);
+
+	g_main_context_unref(priv->main_ctx);
+	priv->main_ctx = g_main_context_ref(main_ctx);
+
+	if (idle_pending) {
+		priv->idle_events_id =
+		    g_usb_context_source_add(self, 0, g_usb_context_idle_hotplug_cb);
 	}
-	if (priv->hotplug_poll_interval > 0) {
-		priv->hotplug_poll_id =
-		    g_timeout_add(priv->hotplug_poll_interval, g_usb_context_rescan_cb, self);
+	if (debounce_pending) {
+		GSourceFunc func = g_usb_context_hotplug_debounce_cb;
+		priv->hotplug_debounce_id =
+		    g_usb_context_source_add(self, priv->hotplug_debounce, func);
+	}
+	if (poll_pending)
+		g_usb_context_ensure_rescan_timeout(self);
+	if (priv->emulate_source != NULL) {
+		g_source_unref(priv->emulate_source);
+		priv->emulate_source = g_idle_source_new();
+		g_source_set_callback(priv->emulate_source, g_usb_context_emulate_cb, self, NULL);
+		g_source_attach(priv->emulate_source, priv->main_ctx);
 	}
 }
 
@@ -832,6 +2664,86 @@ g_usb_context_set_hotplug_poll_interval(GUsbContext *self, guint hotplug_poll_in
 		g_usb_context_ensure_rescan_timeout(self);
 }
 
+/**
+ * g_usb_context_get_hotplug_debounce:
+ * @self: a #GUsbContext
+ *
+ * Gets the window used to collapse hotplug events.
+ *
+ * Return value: interval in ms, or 0 if events are not debounced
+ *
+ * Since: 0.5.0
+ **/
+guint
+g_usb_context_get_hotplug_debounce(GUsbContext *self)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), 0);
+	return priv->hotplug_debounce;
+}
+
+/**
+ * g_usb_context_set_hotplug_debounce:
+ * @self: a #GUsbContext
+ * @hotplug_debounce: the window in ms, or 0 to disable
+ *
+ * Sets a window to hold back hotplug events for, so that a device that arrives and then leaves
+ * again within the window, for instance when rebooting into a bootloader, does not emit the
+ * #GUsbContext::device-added and #GUsbContext::device-removed signals.
+ *
+ * Events are held until no further event has been received for the whole window, or for at most
+ * four windows while events keep arriving. Events are not debounced by default. Changing the
+ * window applies to the next event received.
+ *
+ * Since: 0.5.0
+ **/
+void
+g_usb_context_set_hotplug_debounce(GUsbContext *self, guint hotplug_debounce)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_return_if_fail(G_USB_IS_CONTEXT(self));
+	priv->hotplug_debounce = hotplug_debounce;
+}
+
+/**
+ * g_usb_context_add_match_rule:
+ * @self: a #GUsbContext
+ * @vid: a vendor ID, or -1 to match any
+ * @pid: a product ID, or -1 to match any
+ * @device_class: a `bDeviceClass` value, or -1 to match any
+ *
+ * Adds a rule that devices have to match to be added to the context. Devices that do not match
+ * any rule are never wrapped, opened or signalled, and where hotplug is supported the rules are
+ * also used to filter the events from libusb.
+ *
+ * If no rules are added then all devices are added. This should be called before
+ * g_usb_context_enumerate().
+ *
+ * Since: 0.5.0
+ **/
+void
+g_usb_context_add_match_rule(GUsbContext *self, gint vid, gint pid, gint device_class)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GUsbContextMatchRule rule = {
+	    .vid = vid,
+	    .pid = pid,
+	    .device_class = device_class,
+	};
+
+	g_return_if_fail(G_USB_IS_CONTEXT(self));
+	g_return_if_fail(vid >= -1 && vid <= G_MAXUINT16);
+	g_return_if_fail(pid >= -1 && pid <= G_MAXUINT16);
+	g_return_if_fail(device_class >= -1 && device_class <= G_MAXUINT8);
+	g_return_if_fail(!priv->done_enumerate);
+
+	/* the first rule replaces the callback that matches everything */
+	if (priv->match_rules->len == 0)
+		g_usb_context_hotplug_deregister(self);
+	g_array_append_val(priv->match_rules, rule);
+	g_usb_context_hotplug_register(self, vid, pid, device_class);
+}
+
 /**
  * g_usb_context_enumerate:
  * @self: a #GUsbContext
@@ -847,11 +2759,17 @@ void
 g_usb_context_enumerate(GUsbContext *self)
 {
 	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GHashTable) signalled = NULL;
 
 	/* only ever initially scan once, then rely on hotplug / poll */
 	if (priv->done_enumerate)
 		return;
 
+	/* published by a cancelled g_usb_context_enumerate_async() */
+	signalled = g_hash_table_new_full(g_direct_hash, g_direct_equal, g_object_unref, NULL);
+	for (guint i = 0; i < priv->devices->len; i++)
+		g_hash_table_add(signalled, g_object_ref(g_ptr_array_index(priv->devices, i)));
+
 	g_usb_context_rescan(self);
 	if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
 		g_debug("platform does not do hotplug, using polling");
@@ -861,15 +2779,231 @@ g_usb_context_enumerate(GUsbContext *self)
 
 	/* emit device-added signals before returning */
 	for (guint i = 0; i < priv->devices->len; i++) {
-		g_signal_emit(self,
-			      signals[DEVICE_ADDED_SIGNAL],
-			      0,
-			      g_ptr_array_index(priv->devices, i));
+		GUsbDevice *device = g_ptr_array_index(priv->devices, i);
+		if (g_hash_table_contains(signalled, device))
+			continue;
+		g_signal_emit(self, signals[DEVICE_ADDED_SIGNAL], 0, device);
 	}
 
 	/* any queued up hotplug events are queued as idle handlers */
 }
 
+/* always in the main thread */
+static gboolean
+g_usb_context_enumerate_publish_cb(gpointer user_data)
+{
+	GUsbContextEnumerateHelper *helper = (GUsbContextEnumerateHelper *)user_data;
+	GUsbContextPrivate *priv = GET_PRIVATE(helper->self);
+	GUsbDevice *device = helper->device;
+
+	/* the next enumerate adds it instead */
+	if (g_cancellable_is_cancelled(helper->cancellable))
+		return G_SOURCE_REMOVE;
+
+	/* already added by a hotplug event */
+	if (g_hash_table_contains(priv->devices_by_bus_address,
+				  G_USB_CONTEXT_BUS_ADDRESS_KEY(g_usb_device_get_bus(device),
+								g_usb_device_get_address(device))))
+		return G_SOURCE_REMOVE;
+	g_usb_context_publish_device(helper->self, device);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+g_usb_context_enumerate_start(GUsbContext *self, GTask *task);
+
+/* always in the main thread */
+static gboolean
+g_usb_context_enumerate_done_cb(gpointer user_data)
+{
+	GTask *task = G_TASK(user_data);
+	GUsbContext *self = g_task_get_source_object(task);
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GPtrArray) tasks = g_steal_pointer(&priv->enumerate_tasks);
+
+	priv->enumerate_tasks = g_ptr_array_new_with_free_func((GDestroyNotify)g_object_unref);
+
+	/* the next enumerate will add the devices that were not reached, and only signal those */
+	if (g_task_return_error_if_cancelled(task)) {
+		priv->done_enumerate = FALSE;
+		for (guint i = 0; i < tasks->len; i++) {
+			GTask *task_tmp = g_ptr_array_index(tasks, i);
+			if (task_tmp == task || g_task_return_error_if_cancelled(task_tmp))
+				continue;
+			if (priv->enumerate_tasks->len == 0)
+				g_usb_context_enumerate_start(self, task_tmp);
+			else
+				g_ptr_array_add(priv->enumerate_tasks, g_object_ref(task_tmp));
+		}
+		return G_SOURCE_REMOVE;
+	}
+	if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+		g_debug("platform does not do hotplug, using polling");
+		g_usb_context_ensure_rescan_timeout(self);
+	}
+	for (guint i = 0; i < tasks->len; i++) {
+		GTask *task_tmp = g_ptr_array_index(tasks, i);
+		if (!g_task_return_error_if_cancelled(task_tmp))
+			g_task_return_boolean(task_tmp, TRUE);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+/* an idle source rather than g_main_context_invoke(), which may run @func in this thread */
+static void
+g_usb_context_idle_invoke(GUsbContext *self,
+			  GSourceFunc func,
+			  gpointer user_data,
+			  GDestroyNotify notify)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GSource) source = g_idle_source_new();
+
+	g_source_set_priority(source, G_PRIORITY_DEFAULT);
+	g_source_set_callback(source, func, user_data, notify);
+	g_source_attach(source, priv->main_ctx);
+}
+
+/* this is run in a worker thread */
+static gpointer
+g_usb_context_enumerate_thread_cb(gpointer user_data)
+{
+	GTask *task = G_TASK(user_data);
+	GUsbContext *self = g_task_get_source_object(task);
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GCancellable *cancellable = g_task_get_cancellable(task);
+	g_autoptr(GPtrArray) dev_list = g_usb_context_get_device_list(self);
+
+	for (guint i = 0; i < dev_list->len; i++) {
+		libusb_device *dev = g_ptr_array_index(dev_list, i);
+		GUsbContextEnumerateHelper *helper;
+		g_autoptr(GError) error = NULL;
+		g_autoptr(GUsbDevice) device = NULL;
+
+		if (g_cancellable_is_cancelled(cancellable))
+			break;
+		if (!g_usb_context_match_rules(self, dev))
+			continue;
+		device = _g_usb_device_new(self, dev, &error);
+		if (device == NULL) {
+			g_debug("There was a problem creating the device: %s", error->message);
+			continue;
+		}
+		if (priv->flags & G_USB_CONTEXT_FLAGS_AUTO_OPEN_DEVICES) {
+			if (!_g_usb_device_open_internal(device, &error)) {
+				g_warning("cannot open the device: %s", error->message);
+				continue;
+			}
+		}
+
+		/* as each device is ready, in list order */
+		helper = g_new0(GUsbContextEnumerateHelper, 1);
+		helper->self = g_object_ref(self);
+		helper->device = g_steal_pointer(&device);
+		if (cancellable != NULL)
+			helper->cancellable = g_object_ref(cancellable);
+		g_usb_context_idle_invoke(self,
+					  g_usb_context_enumerate_publish_cb,
+					  helper,
+					  (GDestroyNotify)g_usb_context_enumerate_helper_free);
+	}
+
+	/* queued after all the devices, and this owns the task reference */
+	g_usb_context_idle_invoke(self, g_usb_context_enumerate_done_cb, task, g_object_unref);
+	return NULL;
+}
+
+static void
+g_usb_context_enumerate_start(GUsbContext *self, GTask *task)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GThread *thread;
+	g_autoptr(GError) error = NULL;
+
+	/* hotplug events are accepted from now on */
+	priv->done_enumerate = TRUE;
+	thread = g_thread_try_new("GUsbEnumerate",
+				  g_usb_context_enumerate_thread_cb,
+				  g_object_ref(task),
+				  &error);
+	if (thread == NULL) {
+		priv->done_enumerate = FALSE;
+		g_object_unref(task);
+		g_task_return_error(task, g_steal_pointer(&error));
+		return;
+	}
+	g_ptr_array_add(priv->enumerate_tasks, g_object_ref(task));
+	g_thread_unref(thread);
+}
+
+/**
+ * g_usb_context_enumerate_async:
+ * @self: a #GUsbContext
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: the function to run on completion
+ * @user_data: the data to pass to @callback
+ *
+ * Enumerates all the USB devices and adds them to the context, without blocking the main thread.
+ *
+ * The device list and descriptors are read in a worker thread, and each device is added with a
+ * #GUsbContext::device-added signal as soon as it is ready, so callers can start using devices
+ * before the whole tree is known. Functions that would enumerate, such as
+ * g_usb_context_get_devices(), return the devices added so far while this is in progress.
+ *
+ * If an enumeration is already in progress then this completes when that one does.
+ *
+ * Since: 0.5.0
+ **/
+void
+g_usb_context_enumerate_async(GUsbContext *self,
+			      GCancellable *cancellable,
+			      GAsyncReadyCallback callback,
+			      gpointer user_data)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GTask) task = NULL;
+
+	g_return_if_fail(G_USB_IS_CONTEXT(self));
+	g_return_if_fail(cancellable == NULL || G_IS_CANCELLABLE(cancellable));
+
+	task = g_task_new(self, cancellable, callback, user_data);
+	g_task_set_source_tag(task, g_usb_context_enumerate_async);
+
+	/* in progress */
+	if (priv->enumerate_tasks->len > 0) {
+		g_ptr_array_add(priv->enumerate_tasks, g_steal_pointer(&task));
+		return;
+	}
+
+	/* already done */
+	if (priv->done_enumerate) {
+		g_task_return_boolean(task, TRUE);
+		return;
+	}
+	g_usb_context_enumerate_start(self, task);
+}
+
+/**
+ * g_usb_context_enumerate_finish:
+ * @self: a #GUsbContext
+ * @res: a #GAsyncResult
+ * @error: a #GError, or %NULL
+ *
+ * Gets the result from g_usb_context_enumerate_async().
+ *
+ * Return value: %TRUE on success
+ *
+ * Since: 0.5.0
+ **/
+gboolean
+g_usb_context_enumerate_finish(GUsbContext *self, GAsyncResult *res, GError **error)
+{
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), FALSE);
+	g_return_val_if_fail(g_task_is_valid(res, self), FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	return g_task_propagate_boolean(G_TASK(res), error);
+}
+
 /**
  * g_usb_context_set_flags:
  * @self: a #GUsbContext
@@ -911,22 +3045,79 @@ _g_usb_context_has_flag(GUsbContext *self, GUsbContextFlags flag)
 	return (priv->flags & flag) > 0;
 }
 
+/* this is run in the event thread, as the scheduling applies to the calling thread */
+static void
+g_usb_context_event_thread_setup(GUsbContext *self)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+
+	if (priv->thread_event_policy != G_USB_CONTEXT_THREAD_POLICY_DEFAULT) {
+#ifdef HAVE_PTHREAD_SETSCHEDPARAM
+		struct sched_param param = {.sched_priority = priv->thread_event_priority};
+		gint policy = priv->thread_event_policy == G_USB_CONTEXT_THREAD_POLICY_FIFO
+				  ? SCHED_FIFO
+				  : SCHED_RR;
+		gint rc = pthread_setschedparam(pthread_self(), policy, &param);
+		if (rc != 0)
+			g_warning("failed to set event thread policy: %s", g_strerror(rc));
+#else
+		g_warning("setting the event thread policy is not supported");
+#endif
+	}
+	if (priv->thread_event_affinity != 0) {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+		cpu_set_t cpuset;
+		gint rc;
+
+		CPU_ZERO(&cpuset);
+		for (guint i = 0; i < 64; i++) {
+			if (priv->thread_event_affinity & ((guint64)1 << i))
+				CPU_SET(i, &cpuset);
+		}
+		rc = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+		if (rc != 0)
+			g_warning("failed to set event thread affinity: %s", g_strerror(rc));
+#else
+		g_warning("setting the event thread affinity is not supported");
+#endif
+	}
+}
+
 static gpointer
 g_usb_context_event_thread_cb(gpointer data)
 {
-	GUsbContext *self = G_USB_CONTEXT(data);
-	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GUsbContextShard *shard = (GUsbContextShard *)data;
 	struct timeval tv = {
 	    .tv_usec = 0,
 	    .tv_sec = 2,
 	};
 
-	while (g_atomic_int_get(&priv->thread_event_run) > 0)
-		libusb_handle_events_timeout_completed(priv->ctx, &tv, NULL);
+	g_usb_context_event_thread_setup(shard->self);
+	while (g_atomic_int_get(&shard->run) > 0)
+		libusb_handle_events_timeout_completed(shard->ctx, &tv, &shard->completed);
 
 	return NULL;
 }
 
+static void
+g_usb_context_event_thread_start(GUsbContext *self)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+
+	for (guint i = 0; i < priv->shards->len; i++) {
+		GUsbContextShard *shard = g_ptr_array_index(priv->shards, i);
+		g_autofree gchar *name = NULL;
+
+		shard->run = 1;
+		shard->completed = 0;
+		if (i == 0)
+			name = g_strdup(priv->thread_event_name);
+		else
+			name = g_strdup_printf("%s-%u", priv->thread_event_name, i);
+		shard->thread = g_thread_new(name, g_usb_context_event_thread_cb, shard);
+	}
+}
+
 static void
 g_usb_context_init(GUsbContext *self)
 {
@@ -935,14 +3126,49 @@ g_usb_context_init(GUsbContext *self)
 	priv->flags = G_USB_CONTEXT_FLAGS_NONE;
 	priv->hotplug_poll_interval = G_USB_CONTEXT_HOTPLUG_POLL_INTERVAL_DEFAULT;
 	priv->devices = g_ptr_array_new_with_free_func((GDestroyNotify)g_object_unref);
+	g_mutex_init(&priv->devices_mutex);
 	priv->devices_removed = g_ptr_array_new_with_free_func((GDestroyNotify)g_object_unref);
+	priv->hotplug_ids = g_array_new(FALSE, FALSE, sizeof(GUsbContextHotplugId));
+	priv->match_rules = g_array_new(FALSE, FALSE, sizeof(GUsbContextMatchRule));
+	priv->enumerate_tasks = g_ptr_array_new_with_free_func((GDestroyNotify)g_object_unref);
+	priv->dict_removed = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	priv->devices_by_bus_address = g_hash_table_new_full(g_direct_hash,
+							     g_direct_equal,
+							     NULL,
+							     (GDestroyNotify)g_ptr_array_unref);
+	priv->devices_by_platform_id = g_hash_table_new_full(g_str_hash,
+							     g_str_equal,
+							     g_free,
+							     (GDestroyNotify)g_ptr_array_unref);
+	priv->devices_by_vid_pid = g_hash_table_new_full(g_direct_hash,
+							 g_direct_equal,
+							 NULL,
+							 (GDestroyNotify)g_ptr_array_unref);
 	priv->dict_usb_ids = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 	priv->dict_replug = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	priv->replug_waiters = g_ptr_array_new();
+	priv->blobs = g_new0(GUsbContextBlobs, 1);
+	priv->blobs->refcount = 1;
+	priv->blobs->dict = g_hash_table_new_full(g_bytes_hash,
+						  g_bytes_equal,
+						  NULL,
+						  (GDestroyNotify)g_usb_context_blob_free);
+	g_mutex_init(&priv->blobs->mutex);
+	priv->descriptor_cache = g_hash_table_new_full(g_str_hash,
+						       g_str_equal,
+						       g_free,
+						       (GDestroyNotify)json_object_unref);
+	g_mutex_init(&priv->descriptor_cache_mutex);
+	g_queue_init(&priv->emulate_queue);
 
 	/* to escape the thread into the mainloop */
 	g_mutex_init(&priv->idle_events_mutex);
 	priv->idle_events =
 	    g_ptr_array_new_with_free_func((GDestroyNotify)g_usb_context_idle_helper_free);
+	priv->idle_events_spare =
+	    g_ptr_array_new_with_free_func((GDestroyNotify)g_usb_context_idle_helper_free);
+	priv->hotplug_debounced =
+	    g_ptr_array_new_with_free_func((GDestroyNotify)g_usb_context_idle_helper_free);
 }
 
 static gboolean
@@ -950,41 +3176,38 @@ g_usb_context_initable_init(GInitable *initable, GCancellable *cancellable, GErr
 {
 	GUsbContext *self = G_USB_CONTEXT(initable);
 	GUsbContextPrivate *priv = GET_PRIVATE(self);
-	gint rc;
-	libusb_context *ctx;
-
-	rc = libusb_init(&ctx);
-	if (rc < 0) {
-		g_set_error(error,
-			    G_USB_CONTEXT_ERROR,
-			    G_USB_CONTEXT_ERROR_INTERNAL,
-			    "failed to init libusb: %s [%i]",
-			    g_usb_strerror(rc),
-			    rc);
-		return FALSE;
+	g_autoptr(GPtrArray) shards =
+	    g_ptr_array_new_with_free_func((GDestroyNotify)g_usb_context_shard_free);
+
+	for (guint i = 0; i < priv->event_shards; i++) {
+		GUsbContextShard *shard = g_new0(GUsbContextShard, 1);
+		gint rc;
+
+		shard->self = self;
+		g_ptr_array_add(shards, shard);
+		rc = libusb_init(&shard->ctx);
+		if (rc < 0) {
+			g_set_error(error,
+				    G_USB_CONTEXT_ERROR,
+				    G_USB_CONTEXT_ERROR_INTERNAL,
+				    "failed to init libusb: %s [%i]",
+				    g_usb_strerror(rc),
+				    rc);
+			return FALSE;
+		}
 	}
 
 	priv->main_ctx = g_main_context_ref(g_main_context_default());
-	priv->ctx = ctx;
-	priv->thread_event_run = 1;
-	priv->thread_event = g_thread_new("GUsbEventThread", g_usb_context_event_thread_cb, self);
+	priv->shards = g_steal_pointer(&shards);
+	priv->ctx = ((GUsbContextShard *)g_ptr_array_index(priv->shards, 0))->ctx;
+	g_usb_context_apply_debug_level(self);
+	g_usb_context_event_thread_start(self);
 
 	/* watch for add/remove */
-	if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
-		rc = libusb_hotplug_register_callback(priv->ctx,
-						      LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
-							  LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
-						      0,
-						      LIBUSB_HOTPLUG_MATCH_ANY,
-						      LIBUSB_HOTPLUG_MATCH_ANY,
-						      LIBUSB_HOTPLUG_MATCH_ANY,
-						      g_usb_context_hotplug_cb,
-						      self,
-						      &priv->hotplug_id);
-		if (rc != LIBUSB_SUCCESS) {
-			g_warning("Error creating a hotplug callback: %s", g_usb_strerror(rc));
-		}
-	}
+	g_usb_context_hotplug_register(self,
+				       LIBUSB_HOTPLUG_MATCH_ANY,
+				       LIBUSB_HOTPLUG_MATCH_ANY,
+				       LIBUSB_HOTPLUG_MATCH_ANY);
 
 	return TRUE;
 }
@@ -1017,16 +3240,49 @@ _g_usb_context_get_context(GUsbContext *self)
  * @self: a #GUsbContext
  * @main_ctx: a #GMainContext, or %NULL
  *
- * This function does nothing.
+ * Handles the libusb events from @main_ctx rather than from a dedicated thread, so that transfers
+ * complete and hotplug events arrive without a cross-thread hop. The event thread is stopped the
+ * first time this is called, and later calls return the same source.
  *
- * Return value: (transfer none): the #GUsbSource.
+ * If @main_ctx is not %NULL it is also set as the main context using
+ * g_usb_context_set_main_context(), so that the hotplug signals and the rescan timeout are
+ * dispatched in the same thread as the transfers.
+ *
+ * Passing the #GMainContext of a thread created by the caller allows the events to be handled in a
+ * thread with any scheduling. This is not supported on all platforms, e.g. Windows, in which case
+ * the event thread is kept.
+ *
+ * Return value: (transfer none): the #GUsbSource, or %NULL if not supported
  *
  * Since: 0.1.0
  **/
 GUsbSource *
 g_usb_context_get_source(GUsbContext *self, GMainContext *main_ctx)
 {
-	return NULL;
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GError) error = NULL;
+
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), NULL);
+
+	if (priv->source != NULL)
+		return priv->source;
+	if (priv->shards->len > 1) {
+		g_warning("cannot handle events in the main context with %u event shards",
+			  priv->shards->len);
+		return NULL;
+	}
+
+	/* the thread must not handle events at the same time */
+	g_usb_context_event_thread_stop(self);
+	priv->source = _g_usb_source_new(main_ctx, priv->ctx, &error);
+	if (priv->source == NULL) {
+		g_warning("cannot handle events in the main context: %s", error->message);
+		g_usb_context_event_thread_start(self);
+		return NULL;
+	}
+	if (main_ctx != NULL)
+		g_usb_context_set_main_context(self, main_ctx);
+	return priv->source;
 }
 
 /**
@@ -1060,16 +3316,330 @@ g_usb_context_set_debug(GUsbContext *self, GLogLevelFlags flags)
 
 	if (debug_level != priv->debug_level) {
 		priv->debug_level = debug_level;
-#ifdef HAVE_LIBUSB_SET_OPTION
-		libusb_set_option(priv->ctx, LIBUSB_OPTION_LOG_LEVEL, debug_level);
-#else
-		libusb_set_debug(priv->ctx, debug_level);
-#endif
+		g_usb_context_apply_debug_level(self);
 
 		g_object_notify_by_pspec(G_OBJECT(self), pspecs[PROP_DEBUG_LEVEL]);
 	}
 }
 
+/* private */
+GBytes *
+_g_usb_context_intern_bytes(GUsbContext *self, GBytes *bytes)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GUsbContextBlob *blob;
+	gconstpointer data;
+	gsize bufsz = 0;
+
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), NULL);
+	g_return_val_if_fail(bytes != NULL, NULL);
+
+	/* events are recorded from the libusb event thread too */
+	g_mutex_lock(&priv->blobs->mutex);
+	blob = g_hash_table_lookup(priv->blobs->dict, bytes);
+	if (blob == NULL) {
+		blob = g_new0(GUsbContextBlob, 1);
+		blob->blobs = g_usb_context_blobs_ref(priv->blobs);
+		blob->bytes = g_bytes_ref(bytes);
+		g_hash_table_insert(priv->blobs->dict, blob->bytes, blob);
+	}
+	blob->users++;
+	g_mutex_unlock(&priv->blobs->mutex);
+
+	/* each user gets its own wrapper, so the entry is dropped with the last one */
+	data = g_bytes_get_data(blob->bytes, &bufsz);
+	return g_bytes_new_with_free_func(data, bufsz, g_usb_context_blob_release_cb, blob);
+}
+
+/* private */
+guint
+_g_usb_context_get_blob_count(GUsbContext *self)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	guint count;
+
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), 0);
+
+	g_mutex_lock(&priv->blobs->mutex);
+	count = g_hash_table_size(priv->blobs->dict);
+	g_mutex_unlock(&priv->blobs->mutex);
+	return count;
+}
+
+/**
+ * _g_usb_context_get_cached_descriptors:
+ * @self: a #GUsbContext
+ * @key: a cache key, e.g. `273f:1004:0100`
+ * @kind: a JSON member name, e.g. `UsbHidDescriptors`
+ *
+ * Gets descriptors that were previously read from a device with the same firmware.
+ *
+ * Return value: (transfer full) (nullable): a #JsonNode, or %NULL if not cached
+ *
+ * Since: 0.5.0
+ **/
+JsonNode *
+_g_usb_context_get_cached_descriptors(GUsbContext *self, const gchar *key, const gchar *kind)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	JsonObject *json_object;
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), NULL);
+	g_return_val_if_fail(key != NULL, NULL);
+	g_return_val_if_fail(kind != NULL, NULL);
+
+	/* devices may be probed from worker threads */
+	locker = g_mutex_locker_new(&priv->descriptor_cache_mutex);
+	json_object = g_hash_table_lookup(priv->descriptor_cache, key);
+	if (json_object == NULL || !json_object_has_member(json_object, kind))
+		return NULL;
+	return json_node_copy(json_object_get_member(json_object, kind));
+}
+
+/**
+ * _g_usb_context_set_cached_descriptors:
+ * @self: a #GUsbContext
+ * @key: a cache key, e.g. `273f:1004:0100`
+ * @kind: a JSON member name, e.g. `UsbHidDescriptors`
+ * @json_node: (transfer full): a #JsonNode
+ *
+ * Adds descriptors read from a device so that other devices with the same firmware do not need
+ * to be queried.
+ *
+ * Since: 0.5.0
+ **/
+void
+_g_usb_context_set_cached_descriptors(GUsbContext *self,
+				      const gchar *key,
+				      const gchar *kind,
+				      JsonNode *json_node)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	JsonObject *json_object_old;
+	JsonObject *json_object = json_object_new();
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail(G_USB_IS_CONTEXT(self));
+	g_return_if_fail(key != NULL);
+	g_return_if_fail(kind != NULL);
+	g_return_if_fail(json_node != NULL);
+
+	/* entries are replaced rather than changed, as the saver may still be using the old one */
+	locker = g_mutex_locker_new(&priv->descriptor_cache_mutex);
+	json_object_old = g_hash_table_lookup(priv->descriptor_cache, key);
+	if (json_object_old != NULL) {
+		g_autoptr(GList) members = json_object_get_members(json_object_old);
+		for (GList *l = members; l != NULL; l = l->next) {
+			const gchar *member = l->data;
+			json_object_set_member(json_object,
+					       member,
+					       json_object_dup_member(json_object_old, member));
+		}
+	}
+	json_object_set_member(json_object, kind, json_node);
+	g_hash_table_insert(priv->descriptor_cache, g_strdup(key), json_object);
+}
+
+/**
+ * _g_usb_context_remove_cached_descriptors:
+ * @self: a #GUsbContext
+ * @key: a cache key, e.g. `273f:1004:0100`
+ *
+ * Removes all the cached descriptors for the key.
+ *
+ * Since: 0.5.0
+ **/
+void
+_g_usb_context_remove_cached_descriptors(GUsbContext *self, const gchar *key)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	g_return_if_fail(G_USB_IS_CONTEXT(self));
+	g_return_if_fail(key != NULL);
+
+	locker = g_mutex_locker_new(&priv->descriptor_cache_mutex);
+	g_hash_table_remove(priv->descriptor_cache, key);
+}
+
+/* every member of each array has to be the type the device loader expects */
+static gboolean
+g_usb_context_descriptor_cache_array_valid(JsonObject *json_object,
+					   const gchar *kind,
+					   JsonNodeType node_type)
+{
+	JsonNode *json_node;
+	JsonArray *json_array;
+
+	if (!json_object_has_member(json_object, kind))
+		return TRUE;
+	json_node = json_object_get_member(json_object, kind);
+	if (!JSON_NODE_HOLDS_ARRAY(json_node))
+		return FALSE;
+	json_array = json_node_get_array(json_node);
+	for (guint i = 0; i < json_array_get_length(json_array); i++) {
+		JsonNode *json_element = json_array_get_element(json_array, i);
+		if (json_node_get_node_type(json_element) != node_type)
+			return FALSE;
+		if (node_type == JSON_NODE_VALUE &&
+		    json_node_get_value_type(json_element) != G_TYPE_STRING)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static gboolean
+g_usb_context_descriptor_cache_entry_valid(JsonNode *json_node)
+{
+	JsonObject *json_object;
+
+	if (!JSON_NODE_HOLDS_OBJECT(json_node))
+		return FALSE;
+	json_object = json_node_get_object(json_node);
+	if (!g_usb_context_descriptor_cache_array_valid(json_object,
+							"UsbBosDescriptors",
+							JSON_NODE_OBJECT))
+		return FALSE;
+	if (!g_usb_context_descriptor_cache_array_valid(json_object,
+							"UsbHidDescriptors",
+							JSON_NODE_VALUE))
+		return FALSE;
+	return TRUE;
+}
+
+/**
+ * g_usb_context_load_descriptor_cache:
+ * @self: a #GUsbContext
+ * @filename: a filename created with g_usb_context_save_descriptor_cache()
+ * @error: a #GError, or %NULL
+ *
+ * Loads descriptors that were read from devices by an earlier process, so that devices with the
+ * same VID, PID and bcdDevice do not need to be queried again. Entries already in the cache are
+ * replaced.
+ *
+ * The cache is only used when %G_USB_CONTEXT_FLAGS_CACHE_DESCRIPTORS is set.
+ *
+ * Return value: %TRUE on success
+ *
+ * Since: 0.5.0
+ **/
+gboolean
+g_usb_context_load_descriptor_cache(GUsbContext *self, const gchar *filename, GError **error)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	JsonNode *json_cache_node;
+	JsonNode *json_root;
+	JsonObject *json_cache;
+	g_autoptr(GList) keys = NULL;
+	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(JsonParser) parser = json_parser_new();
+
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), FALSE);
+	g_return_val_if_fail(filename != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+	if (!json_parser_load_from_file(parser, filename, error))
+		return FALSE;
+	json_root = json_parser_get_root(parser);
+	if (json_root == NULL || !JSON_NODE_HOLDS_OBJECT(json_root) ||
+	    !json_object_has_member(json_node_get_object(json_root), "UsbDescriptorCache")) {
+		g_set_error(error,
+			    G_IO_ERROR,
+			    G_IO_ERROR_INVALID_DATA,
+			    "%s is not a GUsb descriptor cache",
+			    filename);
+		return FALSE;
+	}
+	json_cache_node =
+	    json_object_get_member(json_node_get_object(json_root), "UsbDescriptorCache");
+	if (!JSON_NODE_HOLDS_OBJECT(json_cache_node)) {
+		g_set_error(error,
+			    G_IO_ERROR,
+			    G_IO_ERROR_INVALID_DATA,
+			    "%s has an invalid descriptor cache",
+			    filename);
+		return FALSE;
+	}
+
+	/* the cached arrays are used without further checks, so reject the whole file */
+	json_cache = json_node_get_object(json_cache_node);
+	keys = json_object_get_members(json_cache);
+	for (GList *l = keys; l != NULL; l = l->next) {
+		const gchar *key = l->data;
+		if (!g_usb_context_descriptor_cache_entry_valid(json_object_get_member(json_cache,
+										       key))) {
+			g_set_error(error,
+				    G_IO_ERROR,
+				    G_IO_ERROR_INVALID_DATA,
+				    "%s has an invalid descriptor cache entry %s",
+				    filename,
+				    key);
+			return FALSE;
+		}
+	}
+
+	locker = g_mutex_locker_new(&priv->descriptor_cache_mutex);
+	for (GList *l = keys; l != NULL; l = l->next) {
+		const gchar *key = l->data;
+		JsonObject *json_object = json_object_get_object_member(json_cache, key);
+		g_hash_table_insert(priv->descriptor_cache,
+				    g_strdup(key),
+				    json_object_ref(json_object));
+	}
+	return TRUE;
+}
+
+/**
+ * g_usb_context_save_descriptor_cache:
+ * @self: a #GUsbContext
+ * @filename: a filename
+ * @error: a #GError, or %NULL
+ *
+ * Saves the descriptors read from devices when %G_USB_CONTEXT_FLAGS_CACHE_DESCRIPTORS is set,
+ * so that they can be loaded into another process using g_usb_context_load_descriptor_cache().
+ *
+ * Return value: %TRUE on success
+ *
+ * Since: 0.5.0
+ **/
+gboolean
+g_usb_context_save_descriptor_cache(GUsbContext *self, const gchar *filename, GError **error)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+	g_autoptr(JsonBuilder) json_builder = json_builder_new();
+	g_autoptr(JsonGenerator) json_generator = json_generator_new();
+	g_autoptr(JsonNode) json_root = NULL;
+
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), FALSE);
+	g_return_val_if_fail(filename != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+	json_builder_begin_object(json_builder);
+	json_builder_set_member_name(json_builder, "UsbDescriptorCache");
+	json_builder_begin_object(json_builder);
+	g_mutex_lock(&priv->descriptor_cache_mutex);
+	g_hash_table_iter_init(&iter, priv->descriptor_cache);
+	while (g_hash_table_iter_next(&iter, &key, &value)) {
+		JsonNode *json_node = json_node_new(JSON_NODE_OBJECT);
+		json_node_set_object(json_node, (JsonObject *)value);
+		json_builder_set_member_name(json_builder, (const gchar *)key);
+		json_builder_add_value(json_builder, json_node);
+	}
+	g_mutex_unlock(&priv->descriptor_cache_mutex);
+	json_builder_end_object(json_builder);
+	json_builder_end_object(json_builder);
+
+	/* this is written atomically */
+	json_root = json_builder_get_root(json_builder);
+	json_generator_set_root(json_generator, json_root);
+	json_generator_set_pretty(json_generator, TRUE);
+	return json_generator_to_file(json_generator, filename, error);
+}
+
 /**
  * g_usb_context_find_by_bus_address:
  * @self: a #GUsbContext
@@ -1087,18 +3657,18 @@ GUsbDevice *
 g_usb_context_find_by_bus_address(GUsbContext *self, guint8 bus, guint8 address, GError **error)
 {
 	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GUsbDevice *device;
+	g_autoptr(GMutexLocker) locker = NULL;
 
 	g_return_val_if_fail(G_USB_IS_CONTEXT(self), NULL);
 	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
 
 	g_usb_context_enumerate(self);
-	for (guint i = 0; i < priv->devices->len; i++) {
-		GUsbDevice *device = g_ptr_array_index(priv->devices, i);
-		if (g_usb_device_get_bus(device) == bus &&
-		    g_usb_device_get_address(device) == address) {
-			return g_object_ref(device);
-		}
-	}
+	locker = g_mutex_locker_new(&priv->devices_mutex);
+	device = g_usb_context_index_lookup(priv->devices_by_bus_address,
+					    G_USB_CONTEXT_BUS_ADDRESS_KEY(bus, address));
+	if (device != NULL)
+		return g_object_ref(device);
 	g_set_error(error,
 		    G_USB_DEVICE_ERROR,
 		    G_USB_DEVICE_ERROR_NO_DEVICE,
@@ -1124,15 +3694,24 @@ GUsbDevice *
 g_usb_context_find_by_platform_id(GUsbContext *self, const gchar *platform_id, GError **error)
 {
 	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GUsbDevice *device;
+	g_autoptr(GMutexLocker) locker = NULL;
 
 	g_return_val_if_fail(G_USB_IS_CONTEXT(self), NULL);
 	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
 
 	g_usb_context_enumerate(self);
-	for (guint i = 0; i < priv->devices->len; i++) {
-		GUsbDevice *device = g_ptr_array_index(priv->devices, i);
-		if (g_strcmp0(g_usb_device_get_platform_id(device), platform_id) == 0)
+	locker = g_mutex_locker_new(&priv->devices_mutex);
+	if (platform_id != NULL) {
+		device = g_usb_context_index_lookup(priv->devices_by_platform_id, platform_id);
+		if (device != NULL)
 			return g_object_ref(device);
+	} else {
+		for (guint i = 0; i < priv->devices->len; i++) {
+			device = g_ptr_array_index(priv->devices, i);
+			if (g_usb_device_get_platform_id(device) == NULL)
+				return g_object_ref(device);
+		}
 	}
 	g_set_error(error,
 		    G_USB_DEVICE_ERROR,
@@ -1159,17 +3738,18 @@ GUsbDevice *
 g_usb_context_find_by_vid_pid(GUsbContext *self, guint16 vid, guint16 pid, GError **error)
 {
 	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GUsbDevice *device;
+	g_autoptr(GMutexLocker) locker = NULL;
 
 	g_return_val_if_fail(G_USB_IS_CONTEXT(self), NULL);
 	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
 
 	g_usb_context_enumerate(self);
-	for (guint i = 0; i < priv->devices->len; i++) {
-		GUsbDevice *device = g_ptr_array_index(priv->devices, i);
-		if (g_usb_device_get_vid(device) == vid && g_usb_device_get_pid(device) == pid) {
-			return g_object_ref(device);
-		}
-	}
+	locker = g_mutex_locker_new(&priv->devices_mutex);
+	device = g_usb_context_index_lookup(priv->devices_by_vid_pid,
+					    G_USB_CONTEXT_VID_PID_KEY(vid, pid));
+	if (device != NULL)
+		return g_object_ref(device);
 	g_set_error(error,
 		    G_USB_DEVICE_ERROR,
 		    G_USB_DEVICE_ERROR_NO_DEVICE,
@@ -1323,7 +3903,15 @@ _g_usb_context_lookup_product(GUsbContext *self, guint16 vid, guint16 pid, GErro
  * g_usb_context_get_devices:
  * @self: a #GUsbContext
  *
- * Return value: (transfer full) (element-type GUsbDevice): a new #GPtrArray of #GUsbDevice's.
+ * Gets a snapshot of the devices, which is not changed when devices are later added or removed.
+ * Once the context has been enumerated this, and the g_usb_context_find_by_bus_address(),
+ * g_usb_context_find_by_platform_id() and g_usb_context_find_by_vid_pid() lookups, are safe to
+ * call from any thread.
+ *
+ * The returned array is shared with other callers and must not be modified, so copy it first
+ * if it needs to be sorted.
+ *
+ * Return value: (transfer full) (element-type GUsbDevice): a #GPtrArray of #GUsbDevice's.
  *
  * Since: 0.2.2
  **/
@@ -1331,12 +3919,23 @@ GPtrArray *
 g_usb_context_get_devices(GUsbContext *self)
 {
 	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GMutexLocker) locker = NULL;
 
 	g_return_val_if_fail(G_USB_IS_CONTEXT(self), NULL);
 
 	g_usb_context_enumerate(self);
 
-	return g_ptr_array_ref(priv->devices);
+	/* rebuilt only when the devices have changed since it was last requested */
+	locker = g_mutex_locker_new(&priv->devices_mutex);
+	if (priv->devices_snapshot == NULL) {
+		priv->devices_snapshot =
+		    g_ptr_array_new_full(priv->devices->len, (GDestroyNotify)g_object_unref);
+		for (guint i = 0; i < priv->devices->len; i++) {
+			GUsbDevice *device = g_ptr_array_index(priv->devices, i);
+			g_ptr_array_add(priv->devices_snapshot, g_object_ref(device));
+		}
+	}
+	return g_ptr_array_ref(priv->devices_snapshot);
 }
 
 static gboolean
@@ -1408,6 +4007,126 @@ g_usb_context_wait_for_replug(GUsbContext *self,
 	return g_object_ref(replug_helper->device);
 }
 
+static gboolean
+g_usb_context_replug_waiter_timeout_cb(gpointer user_data)
+{
+	GUsbContextReplugWaiter *waiter = (GUsbContextReplugWaiter *)user_data;
+	GError *error = g_error_new_literal(G_USB_CONTEXT_ERROR,
+					    G_USB_CONTEXT_ERROR_INTERNAL,
+					    "request timed out");
+	g_usb_context_replug_waiter_fail(waiter, error);
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+g_usb_context_replug_waiter_cancelled_cb(GCancellable *cancellable, gpointer user_data)
+{
+	GUsbContextReplugWaiter *waiter = (GUsbContextReplugWaiter *)user_data;
+	GError *error = NULL;
+	g_cancellable_set_error_if_cancelled(cancellable, &error);
+	g_usb_context_replug_waiter_fail(waiter, error);
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * g_usb_context_wait_for_replug_async:
+ * @self: a #GUsbContext
+ * @device: a #GUsbDevice
+ * @func: (scope notified) (nullable): a #GUsbContextReplugFunc, or %NULL to match the platform ID
+ * @func_data: the data to pass to @func
+ * @func_notify: (nullable): a #GDestroyNotify for @func_data, or %NULL
+ * @timeout_ms: timeout to wait, or 0 to wait until @cancellable is cancelled
+ * @cancellable: a #GCancellable, or %NULL
+ * @callback: the function to run on completion
+ * @user_data: the data to pass to @callback
+ *
+ * Waits for the device to be replugged, without blocking the main thread. Each device added while
+ * waiting is passed to @func, so the device can be matched if it comes back on a different port
+ * or with a different VID:PID.
+ *
+ * Any number of waits can be in progress at the same time. The #GUsbContext::device-removed and
+ * #GUsbContext::device-added signals are not emitted if the device comes back with the same
+ * platform ID. If it comes back with a different platform ID both signals are emitted, as the
+ * old #GUsbDevice is never coming back. If every wait for the device fails then the removal is
+ * emitted once, and the device-added signal is emitted if the device returns afterwards.
+ *
+ * Since: 0.5.0
+ **/
+void
+g_usb_context_wait_for_replug_async(GUsbContext *self,
+				    GUsbDevice *device,
+				    GUsbContextReplugFunc func,
+				    gpointer func_data,
+				    GDestroyNotify func_notify,
+				    guint timeout_ms,
+				    GCancellable *cancellable,
+				    GAsyncReadyCallback callback,
+				    gpointer user_data)
+{
+	GUsbContextPrivate *priv = GET_PRIVATE(self);
+	GUsbContextReplugWaiter *waiter;
+
+	g_return_if_fail(G_USB_IS_CONTEXT(self));
+	g_return_if_fail(G_USB_IS_DEVICE(device));
+	g_return_if_fail(cancellable == NULL || G_IS_CANCELLABLE(cancellable));
+
+	waiter = g_new0(GUsbContextReplugWaiter, 1);
+	waiter->self = self;
+	waiter->task = g_task_new(self, cancellable, callback, user_data);
+	g_task_set_source_tag(waiter->task, g_usb_context_wait_for_replug_async);
+	waiter->device = g_object_ref(device);
+	waiter->func = func;
+	waiter->user_data = func_data;
+	waiter->user_data_notify = func_notify;
+
+	/* the device may already have been removed while another waiter was waiting for it */
+	for (guint i = 0; i < priv->replug_waiters->len; i++) {
+		GUsbContextReplugWaiter *waiter_tmp = g_ptr_array_index(priv->replug_waiters, i);
+		if (waiter_tmp->device == device && waiter_tmp->removed)
+			waiter->removed = TRUE;
+	}
+
+	/* both are dispatched in the context that handles hotplug events */
+	if (timeout_ms > 0) {
+		waiter->timeout_source = g_timeout_source_new(timeout_ms);
+		g_source_set_callback(waiter->timeout_source,
+				      g_usb_context_replug_waiter_timeout_cb,
+				      waiter,
+				      NULL);
+		g_source_attach(waiter->timeout_source, priv->main_ctx);
+	}
+	if (cancellable != NULL) {
+		waiter->cancellable_source = g_cancellable_source_new(cancellable);
+		g_source_set_callback(waiter->cancellable_source,
+				      (GSourceFunc)g_usb_context_replug_waiter_cancelled_cb,
+				      waiter,
+				      NULL);
+		g_source_attach(waiter->cancellable_source, priv->main_ctx);
+	}
+	g_ptr_array_add(priv->replug_waiters, waiter);
+}
+
+/**
+ * g_usb_context_wait_for_replug_finish:
+ * @self: a #GUsbContext
+ * @res: a #GAsyncResult
+ * @error: a #GError, or %NULL
+ *
+ * Gets the result from g_usb_context_wait_for_replug_async().
+ *
+ * Return value: (transfer full): the replugged #GUsbDevice, or %NULL on error
+ *
+ * Since: 0.5.0
+ **/
+GUsbDevice *
+g_usb_context_wait_for_replug_finish(GUsbContext *self, GAsyncResult *res, GError **error)
+{
+	g_return_val_if_fail(G_USB_IS_CONTEXT(self), NULL);
+	g_return_val_if_fail(g_task_is_valid(res, self), NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	return g_task_propagate_pointer(G_TASK(res), error);
+}
+
 /**
  * g_usb_context_new:
  * @error: a #GError, or %NULL
@@ -44,10 +44,43 @@ typedef enum {
 	G_USB_CONTEXT_FLAGS_SAVE_EVENTS = 1 << 1,
 	G_USB_CONTEXT_FLAGS_SAVE_REMOVED_DEVICES = 1 << 2,
 	G_USB_CONTEXT_FLAGS_DEBUG = 1 << 3,
+	G_USB_CONTEXT_FLAGS_LAZY_LOAD = 1 << 4,
+	G_USB_CONTEXT_FLAGS_SAVE_BLOB_TABLE = 1 << 5,
+	G_USB_CONTEXT_FLAGS_COMPRESS_EVENTS = 1 << 6,
+	G_USB_CONTEXT_FLAGS_CACHE_DESCRIPTORS = 1 << 7,
+	G_USB_CONTEXT_FLAGS_PREFETCH_STRING_DESCRIPTORS = 1 << 8,
 	/*< private >*/
 	G_USB_CONTEXT_FLAGS_LAST
 } GUsbContextFlags;
 
+/**
+ * GUsbContextThreadPolicy:
+ * @G_USB_CONTEXT_THREAD_POLICY_DEFAULT:	The default scheduling of the process
+ * @G_USB_CONTEXT_THREAD_POLICY_FIFO:		Real-time, first-in first-out
+ * @G_USB_CONTEXT_THREAD_POLICY_RR:		Real-time, round-robin
+ *
+ * The scheduling policy of the libusb event thread.
+ **/
+typedef enum {
+	G_USB_CONTEXT_THREAD_POLICY_DEFAULT,
+	G_USB_CONTEXT_THREAD_POLICY_FIFO,
+	G_USB_CONTEXT_THREAD_POLICY_RR,
+} GUsbContextThreadPolicy;
+
+/**
+ * GUsbContextReplugFunc:
+ * @device: the #GUsbDevice that is being waited for
+ * @device_new: a #GUsbDevice that was just added
+ * @user_data: user data
+ *
+ * Decides if a new device is the replugged device, for instance by comparing the serial number.
+ *
+ * Return value: %TRUE if @device_new is the replugged @device
+ **/
+typedef gboolean (*GUsbContextReplugFunc)(GUsbDevice *device,
+					  GUsbDevice *device_new,
+					  gpointer user_data);
+
 GQuark
 g_usb_context_error_quark(void);
 
@@ -59,7 +92,6 @@ g_usb_context_set_flags(GUsbContext *self, GUsbContextFlags flags);
 GUsbContextFlags
 g_usb_context_get_flags(GUsbContext *self);
 
-G_DEPRECATED
 GUsbSource *
 g_usb_context_get_source(GUsbContext *self, GMainContext *main_ctx);
 GMainContext *
@@ -70,9 +102,26 @@ guint
 g_usb_context_get_hotplug_poll_interval(GUsbContext *self);
 void
 g_usb_context_set_hotplug_poll_interval(GUsbContext *self, guint hotplug_poll_interval);
+guint
+g_usb_context_get_hotplug_debounce(GUsbContext *self);
+void
+g_usb_context_set_hotplug_debounce(GUsbContext *self, guint hotplug_debounce);
+guint
+g_usb_context_get_emulation_concurrency(GUsbContext *self);
+void
+g_usb_context_set_emulation_concurrency(GUsbContext *self, guint emulation_concurrency);
 
+void
+g_usb_context_add_match_rule(GUsbContext *self, gint vid, gint pid, gint device_class);
 void
 g_usb_context_enumerate(GUsbContext *self);
+void
+g_usb_context_enumerate_async(GUsbContext *self,
+			      GCancellable *cancellable,
+			      GAsyncReadyCallback callback,
+			      gpointer user_data);
+gboolean
+g_usb_context_enumerate_finish(GUsbContext *self, GAsyncResult *res, GError **error);
 
 gboolean
 g_usb_context_load(GUsbContext *self, JsonObject *json_object, GError **error);
@@ -88,6 +137,40 @@ g_usb_context_save_with_tag(GUsbContext *self,
 			    JsonBuilder *json_builder,
 			    const gchar *tag,
 			    GError **error);
+guint
+g_usb_context_get_generation(GUsbContext *self);
+gboolean
+g_usb_context_load_descriptor_cache(GUsbContext *self, const gchar *filename, GError **error);
+gboolean
+g_usb_context_save_descriptor_cache(GUsbContext *self, const gchar *filename, GError **error);
+gboolean
+g_usb_context_save_delta(GUsbContext *self,
+			 JsonBuilder *json_builder,
+			 const gchar *tag,
+			 guint generation,
+			 GError **error);
+gboolean
+g_usb_context_load_archive(GUsbContext *self,
+			   const gchar *filename,
+			   const gchar *tag,
+			   GError **error);
+gboolean
+g_usb_context_save_archive(GUsbContext *self,
+			   const gchar *filename,
+			   const gchar *tag,
+			   GError **error);
+gboolean
+g_usb_context_load_stream(GUsbContext *self,
+			  GInputStream *stream,
+			  const gchar *tag,
+			  GCancellable *cancellable,
+			  GError **error);
+gboolean
+g_usb_context_save_stream(GUsbContext *self,
+			  GOutputStream *stream,
+			  const gchar *tag,
+			  GCancellable *cancellable,
+			  GError **error);
 
 void
 g_usb_context_set_debug(GUsbContext *self, GLogLevelFlags flags);
@@ -107,5 +190,17 @@ g_usb_context_wait_for_replug(GUsbContext *self,
 			      GUsbDevice *device,
 			      guint timeout_ms,
 			      GError **error);
+void
+g_usb_context_wait_for_replug_async(GUsbContext *self,
+				    GUsbDevice *device,
+				    GUsbContextReplugFunc func,
+				    gpointer func_data,
+				    GDestroyNotify func_notify,
+				    guint timeout_ms,
+				    GCancellable *cancellable,
+				    GAsyncReadyCallback callback,
+				    gpointer user_data);
+GUsbDevice *
+g_usb_context_wait_for_replug_finish(GUsbContext *self, GAsyncResult *res, GError **error);
 
 G_END_DECLS
@@ -16,15 +16,25 @@ G_BEGIN_DECLS
 GUsbDeviceEvent *
 _g_usb_device_event_new(const gchar *id);
 void
-_g_usb_device_event_set_bytes_raw(GUsbDeviceEvent *self, gconstpointer buf, gsize bufsz);
-void
 _g_usb_device_event_set_status(GUsbDeviceEvent *self, gint status);
 void
 _g_usb_device_event_set_rc(GUsbDeviceEvent *self, gint rc);
+void
+_g_usb_device_event_set_repeat(GUsbDeviceEvent *self, guint repeat);
+gboolean
+_g_usb_device_event_is_complete(GUsbDeviceEvent *self);
+gboolean
+_g_usb_device_event_equal(GUsbDeviceEvent *self, GUsbDeviceEvent *other);
 
 gboolean
-_g_usb_device_event_load(GUsbDeviceEvent *self, JsonObject *json_object, GError **error);
+_g_usb_device_event_load(GUsbDeviceEvent *self,
+			 JsonObject *json_object,
+			 GPtrArray *blobs,
+			 GError **error);
 gboolean
-_g_usb_device_event_save(GUsbDeviceEvent *self, JsonBuilder *json_builder, GError **error);
+_g_usb_device_event_save(GUsbDeviceEvent *self,
+			 JsonBuilder *json_builder,
+			 GHashTable *blobs,
+			 GError **error);
 
 G_END_DECLS
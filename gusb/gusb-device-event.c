@@ -20,6 +20,7 @@ struct _GUsbDeviceEvent {
 	gchar *id;
 	gint status;
 	gint rc;
+	guint repeat;
 	GBytes *bytes;
 };
 
@@ -47,10 +48,14 @@ g_usb_device_event_class_init(GUsbDeviceEventClass *klass)
 static void
 g_usb_device_event_init(GUsbDeviceEvent *self)
 {
+	self->repeat = 1;
 }
 
 gboolean
-_g_usb_device_event_load(GUsbDeviceEvent *self, JsonObject *json_object, GError **error)
+_g_usb_device_event_load(GUsbDeviceEvent *self,
+			 JsonObject *json_object,
+			 GPtrArray *blobs,
+			 GError **error)
 {
 	const gchar *str;
 
@@ -64,6 +69,18 @@ _g_usb_device_event_load(GUsbDeviceEvent *self, JsonObject *json_object, GError
 							       "Status",
 							       LIBUSB_TRANSFER_COMPLETED);
 	self->rc = json_object_get_int_member_with_default(json_object, "Error", LIBUSB_SUCCESS);
+	if (json_object_has_member(json_object, "Repeat")) {
+		gint64 repeat = json_object_get_int_member(json_object, "Repeat");
+		if (repeat < 1 || repeat > G_MAXUINT) {
+			g_set_error(error,
+				    G_IO_ERROR,
+				    G_IO_ERROR_INVALID_DATA,
+				    "invalid Repeat %" G_GINT64_FORMAT,
+				    repeat);
+			return FALSE;
+		}
+		self->repeat = (guint)repeat;
+	}
 
 	/* extra data */
 	str = json_object_get_string_member_with_default(json_object, "Data", NULL);
@@ -73,12 +90,31 @@ _g_usb_device_event_load(GUsbDeviceEvent *self, JsonObject *json_object, GError
 		self->bytes = g_bytes_new_take(g_steal_pointer(&buf), bufsz);
 	}
 
+	/* extra data stored out-of-line */
+	if (json_object_has_member(json_object, "DataRef")) {
+		gint64 idx = json_object_get_int_member(json_object, "DataRef");
+		if (blobs == NULL || idx < 0 || idx >= blobs->len) {
+			g_set_error(error,
+				    G_IO_ERROR,
+				    G_IO_ERROR_INVALID_DATA,
+				    "invalid DataRef %" G_GINT64_FORMAT,
+				    idx);
+			return FALSE;
+		}
+		if (self->bytes != NULL)
+			g_bytes_unref(self->bytes);
+		self->bytes = g_bytes_ref(g_ptr_array_index(blobs, idx));
+	}
+
 	/* success */
 	return TRUE;
 }
 
 gboolean
-_g_usb_device_event_save(GUsbDeviceEvent *self, JsonBuilder *json_builder, GError **error)
+_g_usb_device_event_save(GUsbDeviceEvent *self,
+			 JsonBuilder *json_builder,
+			 GHashTable *blobs,
+			 GError **error)
 {
 	g_return_val_if_fail(G_USB_IS_DEVICE_EVENT(self), FALSE);
 	g_return_val_if_fail(json_builder != NULL, FALSE);
@@ -99,7 +135,19 @@ _g_usb_device_event_save(GUsbDeviceEvent *self, JsonBuilder *json_builder, GErro
 		json_builder_set_member_name(json_builder, "Error");
 		json_builder_add_int_value(json_builder, self->rc);
 	}
-	if (self->bytes != NULL) {
+	if (self->repeat > 1) {
+		json_builder_set_member_name(json_builder, "Repeat");
+		json_builder_add_int_value(json_builder, self->repeat);
+	}
+	if (self->bytes != NULL && blobs != NULL) {
+		gpointer idx = NULL;
+		if (!g_hash_table_lookup_extended(blobs, self->bytes, NULL, &idx)) {
+			idx = GUINT_TO_POINTER(g_hash_table_size(blobs));
+			g_hash_table_insert(blobs, g_bytes_ref(self->bytes), idx);
+		}
+		json_builder_set_member_name(json_builder, "DataRef");
+		json_builder_add_int_value(json_builder, GPOINTER_TO_UINT(idx));
+	} else if (self->bytes != NULL) {
 		g_autofree gchar *str = g_base64_encode(g_bytes_get_data(self->bytes, NULL),
 							g_bytes_get_size(self->bytes));
 		json_builder_set_member_name(json_builder, "Data");
@@ -212,6 +260,67 @@ _g_usb_device_event_set_rc(GUsbDeviceEvent *self, gint rc)
 	self->rc = rc;
 }
 
+/**
+ * g_usb_device_event_get_repeat:
+ * @self: a #GUsbDeviceEvent
+ *
+ * Gets the number of consecutive times the event happened.
+ *
+ * Identical events are only merged when the device is saved, and when the context has the
+ * %G_USB_CONTEXT_FLAGS_COMPRESS_EVENTS flag set.
+ *
+ * Return value: a number, typically 1
+ *
+ * Since: 0.5.0
+ **/
+guint
+g_usb_device_event_get_repeat(GUsbDeviceEvent *self)
+{
+	g_return_val_if_fail(G_USB_IS_DEVICE_EVENT(self), 0);
+	return self->repeat;
+}
+
+/**
+ * _g_usb_device_event_set_repeat:
+ * @self: a #GUsbDeviceEvent
+ * @repeat: a number, which must be at least 1
+ *
+ * Set the number of consecutive times the event happened.
+ *
+ * Since: 0.5.0
+ **/
+void
+_g_usb_device_event_set_repeat(GUsbDeviceEvent *self, guint repeat)
+{
+	g_return_if_fail(G_USB_IS_DEVICE_EVENT(self));
+	g_return_if_fail(repeat > 0);
+	self->repeat = repeat;
+}
+
+/* the transfer has finished, either successfully or with an error */
+gboolean
+_g_usb_device_event_is_complete(GUsbDeviceEvent *self)
+{
+	g_return_val_if_fail(G_USB_IS_DEVICE_EVENT(self), FALSE);
+	return self->bytes != NULL || self->status != LIBUSB_TRANSFER_COMPLETED ||
+	       self->rc != LIBUSB_SUCCESS;
+}
+
+/* ignoring the repeat count */
+gboolean
+_g_usb_device_event_equal(GUsbDeviceEvent *self, GUsbDeviceEvent *other)
+{
+	g_return_val_if_fail(G_USB_IS_DEVICE_EVENT(self), FALSE);
+	g_return_val_if_fail(G_USB_IS_DEVICE_EVENT(other), FALSE);
+	if (g_strcmp0(self->id, other->id) != 0)
+		return FALSE;
+	if (self->status != other->status || self->rc != other->rc)
+		return FALSE;
+	if (self->bytes == NULL || other->bytes == NULL)
+		return self->bytes == other->bytes;
+	return g_bytes_equal(self->bytes, other->bytes);
+}
+
 /**
  * g_usb_device_event_get_bytes:
  * @self: a #GUsbDeviceEvent
@@ -247,13 +356,3 @@ g_usb_device_event_set_bytes(GUsbDeviceEvent *self, GBytes *bytes)
 		g_bytes_unref(self->bytes);
 	self->bytes = g_bytes_ref(bytes);
 }
-
-void
-_g_usb_device_event_set_bytes_raw(GUsbDeviceEvent *self, gconstpointer buf, gsize bufsz)
-{
-	g_return_if_fail(G_USB_IS_DEVICE_EVENT(self));
-	g_return_if_fail(buf != NULL);
-	if (self->bytes != NULL)
-		g_bytes_unref(self->bytes);
-	self->bytes = g_bytes_new(buf, bufsz);
-}
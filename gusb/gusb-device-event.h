@@ -22,6 +22,8 @@ gint
 g_usb_device_event_get_status(GUsbDeviceEvent *self);
 gint
 g_usb_device_event_get_rc(GUsbDeviceEvent *self);
+guint
+g_usb_device_event_get_repeat(GUsbDeviceEvent *self);
 void
 g_usb_device_event_set_bytes(GUsbDeviceEvent *self, GBytes *bytes);
 
@@ -15,15 +15,44 @@ G_BEGIN_DECLS
 GUsbDevice *
 _g_usb_device_new(GUsbContext *context, libusb_device *device, GError **error);
 gboolean
-_g_usb_device_load(GUsbDevice *self, JsonObject *json_object, GError **error);
+_g_usb_device_load(GUsbDevice *self, JsonObject *json_object, GPtrArray *blobs, GError **error);
 gboolean
-_g_usb_device_save(GUsbDevice *self, JsonBuilder *json_builder, GError **error);
+_g_usb_device_save(GUsbDevice *self, JsonBuilder *json_builder, GHashTable *blobs, GError **error);
+gboolean
+_g_usb_device_save_stream(GUsbDevice *self,
+			  GOutputStream *stream,
+			  GHashTable *blobs,
+			  GCancellable *cancellable,
+			  GError **error);
 void
 _g_usb_device_add_event(GUsbDevice *self, GUsbDeviceEvent *event);
+void
+_g_usb_device_replace_state(GUsbDevice *self, GUsbDevice *donor);
 
 libusb_device *
 _g_usb_device_get_device(GUsbDevice *self);
 gboolean
 _g_usb_device_open_internal(GUsbDevice *self, GError **error);
+guint8
+_g_usb_device_lookup_custom_index(GUsbDevice *self,
+				  guint8 class_id,
+				  guint8 subclass_id,
+				  guint8 protocol_id,
+				  GError **error);
+GBytes *
+_g_usb_device_lookup_string_descriptor(GUsbDevice *self,
+				       guint8 desc_index,
+				       guint16 langid,
+				       gsize length);
+void
+_g_usb_device_add_string_descriptor(GUsbDevice *self,
+				    guint8 desc_index,
+				    guint16 langid,
+				    GBytes *bytes);
+gint
+_g_usb_device_string_descriptor_to_ascii(const guint8 *buf,
+					 gsize bufsz,
+					 guint8 *data,
+					 gsize length);
 
 G_END_DECLS
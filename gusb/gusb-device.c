@@ -42,12 +42,21 @@ typedef struct {
 	gboolean bos_descriptors_valid;
 	gboolean hid_descriptors_valid;
 	GPtrArray *interfaces;	    /* of GUsbInterface */
+	GHashTable *custom_indexes; /* nullable, class<<16|subclass<<8|protocol : iInterface */
 	GPtrArray *bos_descriptors; /* of GUsbBosDescriptor */
 	GPtrArray *hid_descriptors; /* of GBytes */
+	GHashTable *string_descriptors; /* langid<<8|index : GBytes */
+	GMutex string_descriptors_mutex;
+	GCancellable *prefetch_cancellable; /* nullable */
+	GMutex prefetch_mutex;		    /* held while prefetching */
 	GPtrArray *events;	    /* of GUsbDeviceEvent */
 	GPtrArray *tags;	    /* of utf-8 */
 	guint event_idx;
+	guint event_rep; /* repetitions of the event at event_idx already used */
+	volatile guint generation;
 	GDateTime *created;
+	JsonObject *json_lazy; /* nullable */
+	GPtrArray *blobs_lazy; /* nullable, of GBytes */
 } GUsbDevicePrivate;
 
 enum { PROP_0, PROP_LIBUSB_DEVICE, PROP_CONTEXT, PROP_PLATFORM_ID, N_PROPERTIES };
@@ -89,10 +98,19 @@ g_usb_device_finalize(GObject *object)
 	g_free(priv->platform_id);
 	g_date_time_unref(priv->created);
 	g_ptr_array_unref(priv->interfaces);
+	if (priv->custom_indexes != NULL)
+		g_hash_table_unref(priv->custom_indexes);
 	g_ptr_array_unref(priv->bos_descriptors);
 	g_ptr_array_unref(priv->hid_descriptors);
+	g_hash_table_unref(priv->string_descriptors);
+	g_mutex_clear(&priv->string_descriptors_mutex);
+	g_mutex_clear(&priv->prefetch_mutex);
 	g_ptr_array_unref(priv->events);
 	g_ptr_array_unref(priv->tags);
+	if (priv->json_lazy != NULL)
+		json_object_unref(priv->json_lazy);
+	if (priv->blobs_lazy != NULL)
+		g_ptr_array_unref(priv->blobs_lazy);
 
 	G_OBJECT_CLASS(g_usb_device_parent_class)->finalize(object);
 }
@@ -103,6 +121,7 @@ g_usb_device_dispose(GObject *object)
 	GUsbDevice *self = G_USB_DEVICE(object);
 	GUsbDevicePrivate *priv = GET_PRIVATE(self);
 
+	g_clear_object(&priv->prefetch_cancellable);
 	g_clear_pointer(&priv->device, libusb_unref_device);
 	g_clear_object(&priv->context);
 
@@ -158,6 +177,16 @@ g_usb_device_set_property(GObject *object, guint prop_id, const GValue *value, G
 	}
 }
 
+/* the device will be included in the next delta saved by the context */
+static void
+g_usb_device_bump_generation(GUsbDevice *self)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	if (priv->context == NULL)
+		return;
+	g_atomic_int_set(&priv->generation, _g_usb_context_next_generation(priv->context));
+}
+
 static void
 g_usb_device_constructed(GObject *object)
 {
@@ -170,6 +199,7 @@ g_usb_device_constructed(GObject *object)
 			g_warning("Failed to get USB descriptor for device: %s",
 				  g_usb_strerror(rc));
 	}
+	g_usb_device_bump_generation(self);
 
 	G_OBJECT_CLASS(g_usb_device_parent_class)->constructed(object);
 }
@@ -223,10 +253,191 @@ g_usb_device_init(GUsbDevice *self)
 	priv->interfaces = g_ptr_array_new_with_free_func((GDestroyNotify)g_object_unref);
 	priv->bos_descriptors = g_ptr_array_new_with_free_func((GDestroyNotify)g_object_unref);
 	priv->hid_descriptors = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+	priv->string_descriptors = g_hash_table_new_full(g_direct_hash,
+							 g_direct_equal,
+							 NULL,
+							 (GDestroyNotify)g_bytes_unref);
+	g_mutex_init(&priv->string_descriptors_mutex);
+	g_mutex_init(&priv->prefetch_mutex);
 	priv->events = g_ptr_array_new_with_free_func((GDestroyNotify)g_object_unref);
 	priv->tags = g_ptr_array_new_with_free_func(g_free);
 }
 
+static gboolean
+g_usb_device_load_bos_descriptors(GUsbDevice *self, JsonArray *json_array, GError **error)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	for (guint i = 0; i < json_array_get_length(json_array); i++) {
+		JsonNode *node_tmp = json_array_get_element(json_array, i);
+		JsonObject *obj_tmp = json_node_get_object(node_tmp);
+		g_autoptr(GUsbBosDescriptor) bos_descriptor =
+		    g_object_new(G_USB_TYPE_BOS_DESCRIPTOR, NULL);
+		if (!_g_usb_bos_descriptor_load(bos_descriptor, obj_tmp, error))
+			return FALSE;
+		g_ptr_array_add(priv->bos_descriptors, g_object_ref(bos_descriptor));
+	}
+	return TRUE;
+}
+
+static void
+g_usb_device_load_hid_descriptors(GUsbDevice *self, JsonArray *json_array)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	for (guint i = 0; i < json_array_get_length(json_array); i++) {
+		JsonNode *node_tmp = json_array_get_element(json_array, i);
+		const gchar *tmp = json_node_get_string(node_tmp);
+		if (tmp != NULL) {
+			gsize bufsz = 0;
+			g_autofree guchar *buf = g_base64_decode(tmp, &bufsz);
+			g_ptr_array_add(priv->hid_descriptors,
+					g_bytes_new_take(g_steal_pointer(&buf), bufsz));
+		}
+	}
+}
+
+static void
+g_usb_device_save_hid_descriptors(GPtrArray *hid_descriptors, JsonBuilder *json_builder)
+{
+	json_builder_begin_array(json_builder);
+	for (guint i = 0; i < hid_descriptors->len; i++) {
+		GBytes *bytes = g_ptr_array_index(hid_descriptors, i);
+		g_autofree gchar *str =
+		    g_base64_encode(g_bytes_get_data(bytes, NULL), g_bytes_get_size(bytes));
+		json_builder_add_string_value(json_builder, str);
+	}
+	json_builder_end_array(json_builder);
+}
+
+static gboolean
+g_usb_device_load_arrays(GUsbDevice *self,
+			 JsonObject *json_object,
+			 GPtrArray *blobs,
+			 GError **error)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+
+	/* array of BOS descriptors */
+	if (json_object_has_member(json_object, "UsbBosDescriptors")) {
+		JsonArray *json_array =
+		    json_object_get_array_member(json_object, "UsbBosDescriptors");
+		if (!g_usb_device_load_bos_descriptors(self, json_array, error))
+			return FALSE;
+	}
+
+	/* array of HID descriptors */
+	if (json_object_has_member(json_object, "UsbHidDescriptors")) {
+		JsonArray *json_array =
+		    json_object_get_array_member(json_object, "UsbHidDescriptors");
+		g_usb_device_load_hid_descriptors(self, json_array);
+	}
+
+	/* array of interfaces */
+	if (json_object_has_member(json_object, "UsbInterfaces")) {
+		JsonArray *json_array = json_object_get_array_member(json_object, "UsbInterfaces");
+		for (guint i = 0; i < json_array_get_length(json_array); i++) {
+			JsonNode *node_tmp = json_array_get_element(json_array, i);
+			JsonObject *obj_tmp = json_node_get_object(node_tmp);
+			g_autoptr(GUsbInterface) iface =
+			    g_object_new(G_USB_TYPE_INTERFACE, NULL);
+			if (!_g_usb_interface_load(iface, obj_tmp, error))
+				return FALSE;
+			g_ptr_array_add(priv->interfaces, g_object_ref(iface));
+		}
+	}
+
+	/* array of events */
+	if (json_object_has_member(json_object, "UsbEvents")) {
+		JsonArray *json_array = json_object_get_array_member(json_object, "UsbEvents");
+		for (guint i = 0; i < json_array_get_length(json_array); i++) {
+			JsonNode *node_tmp = json_array_get_element(json_array, i);
+			JsonObject *obj_tmp = json_node_get_object(node_tmp);
+			g_autoptr(GUsbDeviceEvent) event = _g_usb_device_event_new(NULL);
+			GBytes *bytes;
+			if (!_g_usb_device_event_load(event, obj_tmp, blobs, error))
+				return FALSE;
+
+			/* inline data is not already shared */
+			bytes = g_usb_device_event_get_bytes(event);
+			if (blobs == NULL && bytes != NULL) {
+				g_autoptr(GBytes) bytes_shared =
+				    _g_usb_context_intern_bytes(priv->context, bytes);
+				g_usb_device_event_set_bytes(event, bytes_shared);
+			}
+			g_ptr_array_add(priv->events, g_steal_pointer(&event));
+		}
+	}
+
+	/* success */
+	priv->event_idx = 0;
+	priv->event_rep = 0;
+	return TRUE;
+}
+
+static gboolean
+g_usb_device_ensure_loaded(GUsbDevice *self, GError **error)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+
+	/* not lazy, or already done */
+	if (priv->json_lazy == NULL)
+		return TRUE;
+
+	if (_g_usb_context_has_flag(priv->context, G_USB_CONTEXT_FLAGS_DEBUG))
+		g_debug("loading descriptors and events for %s", priv->platform_id);
+	if (!g_usb_device_load_arrays(self, priv->json_lazy, priv->blobs_lazy, error)) {
+		/* keep the JSON so that the same error is returned next time */
+		g_ptr_array_set_size(priv->bos_descriptors, 0);
+		g_ptr_array_set_size(priv->hid_descriptors, 0);
+		g_ptr_array_set_size(priv->interfaces, 0);
+		g_ptr_array_set_size(priv->events, 0);
+		return FALSE;
+	}
+	g_clear_pointer(&priv->json_lazy, json_object_unref);
+	g_clear_pointer(&priv->blobs_lazy, g_ptr_array_unref);
+	return TRUE;
+}
+
+static void
+g_usb_device_ensure_loaded_or_warn(GUsbDevice *self)
+{
+	g_autoptr(GError) error_local = NULL;
+	if (!g_usb_device_ensure_loaded(self, &error_local))
+		g_warning("failed to load device: %s", error_local->message);
+}
+
+/* merge each run of finished and identical events into the first event of the run; this is only
+ * done when saving as the event thread may still be writing the data of events in flight */
+static void
+g_usb_device_compress_events(GUsbDevice *self)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	guint idx = 0;
+
+	if (!_g_usb_context_has_flag(priv->context, G_USB_CONTEXT_FLAGS_COMPRESS_EVENTS))
+		return;
+	if (priv->events->len < 2)
+		return;
+	for (guint i = 1; i < priv->events->len; i++) {
+		GUsbDeviceEvent *event_prev = g_ptr_array_index(priv->events, idx);
+		GUsbDeviceEvent *event = g_ptr_array_index(priv->events, i);
+		if (_g_usb_device_event_is_complete(event_prev) &&
+		    _g_usb_device_event_is_complete(event) &&
+		    _g_usb_device_event_equal(event_prev, event)) {
+			_g_usb_device_event_set_repeat(event_prev,
+						       g_usb_device_event_get_repeat(event_prev) +
+							   g_usb_device_event_get_repeat(event));
+			g_object_unref(event);
+			continue;
+		}
+		priv->events->pdata[++idx] = event;
+	}
+
+	/* the remaining slots were either moved or already unreferenced */
+	g_ptr_array_set_free_func(priv->events, NULL);
+	g_ptr_array_set_size(priv->events, idx + 1);
+	g_ptr_array_set_free_func(priv->events, (GDestroyNotify)g_object_unref);
+}
+
 /* private */
 void
 _g_usb_device_add_event(GUsbDevice *self, GUsbDeviceEvent *event)
@@ -234,11 +445,13 @@ _g_usb_device_add_event(GUsbDevice *self, GUsbDeviceEvent *event)
 	GUsbDevicePrivate *priv = GET_PRIVATE(self);
 	g_return_if_fail(G_USB_IS_DEVICE(self));
 	g_return_if_fail(G_USB_IS_DEVICE_EVENT(event));
+	g_usb_device_ensure_loaded_or_warn(self);
 	g_ptr_array_add(priv->events, g_object_ref(event));
+	g_usb_device_bump_generation(self);
 }
 
 gboolean
-_g_usb_device_load(GUsbDevice *self, JsonObject *json_object, GError **error)
+_g_usb_device_load(GUsbDevice *self, JsonObject *json_object, GPtrArray *blobs, GError **error)
 {
 	GUsbDevicePrivate *priv = GET_PRIVATE(self);
 	const gchar *tmp;
@@ -286,64 +499,6 @@ _g_usb_device_load(GUsbDevice *self, JsonObject *json_object, GError **error)
 	priv->desc.iSerialNumber =
 	    json_object_get_int_member_with_default(json_object, "SerialNumber", 0x0);
 
-	/* array of BOS descriptors */
-	if (json_object_has_member(json_object, "UsbBosDescriptors")) {
-		JsonArray *json_array =
-		    json_object_get_array_member(json_object, "UsbBosDescriptors");
-		for (guint i = 0; i < json_array_get_length(json_array); i++) {
-			JsonNode *node_tmp = json_array_get_element(json_array, i);
-			JsonObject *obj_tmp = json_node_get_object(node_tmp);
-			g_autoptr(GUsbBosDescriptor) bos_descriptor =
-			    g_object_new(G_USB_TYPE_BOS_DESCRIPTOR, NULL);
-			if (!_g_usb_bos_descriptor_load(bos_descriptor, obj_tmp, error))
-				return FALSE;
-			g_ptr_array_add(priv->bos_descriptors, g_object_ref(bos_descriptor));
-		}
-	}
-
-	/* array of HID descriptors */
-	if (json_object_has_member(json_object, "UsbHidDescriptors")) {
-		JsonArray *json_array =
-		    json_object_get_array_member(json_object, "UsbHidDescriptors");
-		for (guint i = 0; i < json_array_get_length(json_array); i++) {
-			JsonNode *node_tmp = json_array_get_element(json_array, i);
-			tmp = json_node_get_string(node_tmp);
-			if (tmp != NULL) {
-				gsize bufsz = 0;
-				g_autofree guchar *buf = g_base64_decode(tmp, &bufsz);
-				g_ptr_array_add(priv->hid_descriptors,
-						g_bytes_new_take(g_steal_pointer(&buf), bufsz));
-			}
-		}
-	}
-
-	/* array of interfaces */
-	if (json_object_has_member(json_object, "UsbInterfaces")) {
-		JsonArray *json_array = json_object_get_array_member(json_object, "UsbInterfaces");
-		for (guint i = 0; i < json_array_get_length(json_array); i++) {
-			JsonNode *node_tmp = json_array_get_element(json_array, i);
-			JsonObject *obj_tmp = json_node_get_object(node_tmp);
-			g_autoptr(GUsbInterface) iface =
-			    g_object_new(G_USB_TYPE_INTERFACE, NULL);
-			if (!_g_usb_interface_load(iface, obj_tmp, error))
-				return FALSE;
-			g_ptr_array_add(priv->interfaces, g_object_ref(iface));
-		}
-	}
-
-	/* array of events */
-	if (json_object_has_member(json_object, "UsbEvents")) {
-		JsonArray *json_array = json_object_get_array_member(json_object, "UsbEvents");
-		for (guint i = 0; i < json_array_get_length(json_array); i++) {
-			JsonNode *node_tmp = json_array_get_element(json_array, i);
-			JsonObject *obj_tmp = json_node_get_object(node_tmp);
-			g_autoptr(GUsbDeviceEvent) event = _g_usb_device_event_new(NULL);
-			if (!_g_usb_device_event_load(event, obj_tmp, error))
-				return FALSE;
-			g_ptr_array_add(priv->events, g_steal_pointer(&event));
-		}
-	}
-
 	/* array of tags */
 	if (json_object_has_member(json_object, "Tags")) {
 		JsonArray *json_array = json_object_get_array_member(json_object, "Tags");
@@ -355,16 +510,27 @@ _g_usb_device_load(GUsbDevice *self, JsonObject *json_object, GError **error)
 		}
 	}
 
+	/* the descriptors and events are loaded when first used */
+	if (_g_usb_context_has_flag(priv->context, G_USB_CONTEXT_FLAGS_LAZY_LOAD)) {
+		priv->json_lazy = json_object_ref(json_object);
+		if (blobs != NULL)
+			priv->blobs_lazy = g_ptr_array_ref(blobs);
+	} else if (!g_usb_device_load_arrays(self, json_object, blobs, error)) {
+		return FALSE;
+	}
+
 	/* success */
 	priv->interfaces_valid = TRUE;
 	priv->bos_descriptors_valid = TRUE;
 	priv->hid_descriptors_valid = TRUE;
 	priv->event_idx = 0;
+	priv->event_rep = 0;
 	return TRUE;
 }
 
-gboolean
-_g_usb_device_save(GUsbDevice *self, JsonBuilder *json_builder, GError **error)
+/* everything apart from the events */
+static gboolean
+g_usb_device_save_properties(GUsbDevice *self, JsonBuilder *json_builder, GError **error)
 {
 	GUsbDevicePrivate *priv = GET_PRIVATE(self);
 	g_autoptr(GPtrArray) bos_descriptors = NULL;
@@ -374,13 +540,6 @@ _g_usb_device_save(GUsbDevice *self, JsonBuilder *json_builder, GError **error)
 	g_autoptr(GError) error_hid = NULL;
 	g_autoptr(GError) error_interfaces = NULL;
 
-	g_return_val_if_fail(G_USB_IS_DEVICE(self), FALSE);
-	g_return_val_if_fail(json_builder != NULL, FALSE);
-	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
-
-	/* start */
-	json_builder_begin_object(json_builder);
-
 	/* optional properties */
 	if (priv->platform_id != NULL) {
 		json_builder_set_member_name(json_builder, "PlatformId");
@@ -466,14 +625,7 @@ _g_usb_device_save(GUsbDevice *self, JsonBuilder *json_builder, GError **error)
 			g_debug("%s", error_hid->message);
 	} else if (hid_descriptors->len > 0) {
 		json_builder_set_member_name(json_builder, "UsbHidDescriptors");
-		json_builder_begin_array(json_builder);
-		for (guint i = 0; i < hid_descriptors->len; i++) {
-			GBytes *bytes = g_ptr_array_index(hid_descriptors, i);
-			g_autofree gchar *str =
-			    g_base64_encode(g_bytes_get_data(bytes, NULL), g_bytes_get_size(bytes));
-			json_builder_add_string_value(json_builder, str);
-		}
-		json_builder_end_array(json_builder);
+		g_usb_device_save_hid_descriptors(hid_descriptors, json_builder);
 	}
 
 	/* array of interfaces */
@@ -492,13 +644,35 @@ _g_usb_device_save(GUsbDevice *self, JsonBuilder *json_builder, GError **error)
 		json_builder_end_array(json_builder);
 	}
 
+	/* success */
+	return TRUE;
+}
+
+gboolean
+_g_usb_device_save(GUsbDevice *self, JsonBuilder *json_builder, GHashTable *blobs, GError **error)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+
+	g_return_val_if_fail(G_USB_IS_DEVICE(self), FALSE);
+	g_return_val_if_fail(json_builder != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+	if (!g_usb_device_ensure_loaded(self, error))
+		return FALSE;
+
+	/* start */
+	json_builder_begin_object(json_builder);
+	if (!g_usb_device_save_properties(self, json_builder, error))
+		return FALSE;
+
 	/* events */
+	g_usb_device_compress_events(self);
 	if (priv->events->len > 0) {
 		json_builder_set_member_name(json_builder, "UsbEvents");
 		json_builder_begin_array(json_builder);
 		for (guint i = 0; i < priv->events->len; i++) {
 			GUsbDeviceEvent *event = g_ptr_array_index(priv->events, i);
-			if (!_g_usb_device_event_save(event, json_builder, error))
+			if (!_g_usb_device_event_save(event, json_builder, blobs, error))
 				return FALSE;
 		}
 		json_builder_end_array(json_builder);
@@ -509,6 +683,80 @@ _g_usb_device_save(GUsbDevice *self, JsonBuilder *json_builder, GError **error)
 	return TRUE;
 }
 
+/* the same as _g_usb_device_save(), but writing one event at a time */
+gboolean
+_g_usb_device_save_stream(GUsbDevice *self,
+			  GOutputStream *stream,
+			  GHashTable *blobs,
+			  GCancellable *cancellable,
+			  GError **error)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	gsize strsz = 0;
+	g_autofree gchar *str = NULL;
+	g_autoptr(JsonBuilder) json_builder = json_builder_new();
+
+	g_return_val_if_fail(G_USB_IS_DEVICE(self), FALSE);
+	g_return_val_if_fail(G_IS_OUTPUT_STREAM(stream), FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+	if (!g_usb_device_ensure_loaded(self, error))
+		return FALSE;
+
+	/* descriptors are small */
+	json_builder_begin_object(json_builder);
+	if (!g_usb_device_save_properties(self, json_builder, error))
+		return FALSE;
+	json_builder_end_object(json_builder);
+	str = _g_usb_json_builder_to_data(json_builder, &strsz);
+	g_usb_device_compress_events(self);
+	if (priv->events->len == 0)
+		return _g_usb_json_write(stream, str, strsz, cancellable, error);
+
+	/* reopen the object to append the events */
+	if (!_g_usb_json_write(stream, str, strsz - 1, cancellable, error))
+		return FALSE;
+	if (!_g_usb_json_write(stream,
+			       strsz > 2 ? ",\"UsbEvents\":[" : "\"UsbEvents\":[",
+			       -1,
+			       cancellable,
+			       error))
+		return FALSE;
+	for (guint i = 0; i < priv->events->len; i++) {
+		GUsbDeviceEvent *event = g_ptr_array_index(priv->events, i);
+		g_autofree gchar *str_event = NULL;
+		g_autoptr(JsonBuilder) json_builder_event = json_builder_new();
+
+		if (i > 0 && !_g_usb_json_write(stream, ",", -1, cancellable, error))
+			return FALSE;
+		if (!_g_usb_device_event_save(event, json_builder_event, blobs, error))
+			return FALSE;
+		str_event = _g_usb_json_builder_to_data(json_builder_event, NULL);
+		if (!_g_usb_json_write(stream, str_event, -1, cancellable, error))
+			return FALSE;
+	}
+	return _g_usb_json_write(stream, "]}", -1, cancellable, error);
+}
+
+/**
+ * g_usb_device_get_generation:
+ * @self: a #GUsbDevice
+ *
+ * Gets the context generation when the device was created or last changed, for instance when an
+ * event was recorded, a tag was added or removed or the device was invalidated.
+ *
+ * Return value: a generation number, or 0 if the device has no context
+ *
+ * Since: 0.5.0
+ **/
+guint
+g_usb_device_get_generation(GUsbDevice *self)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	g_return_val_if_fail(G_USB_IS_DEVICE(self), 0);
+	return g_atomic_int_get(&priv->generation);
+}
+
 /**
  * g_usb_device_get_created:
  * @self: a #GUsbDevice
@@ -599,6 +847,7 @@ g_usb_device_add_tag(GUsbDevice *self, const gchar *tag)
 	if (g_usb_device_has_tag(self, tag))
 		return;
 	g_ptr_array_add(priv->tags, g_strdup(tag));
+	g_usb_device_bump_generation(self);
 }
 
 /**
@@ -622,6 +871,7 @@ g_usb_device_remove_tag(GUsbDevice *self, const gchar *tag)
 		const gchar *tag_tmp = g_ptr_array_index(priv->tags, i);
 		if (g_strcmp0(tag_tmp, tag) == 0) {
 			g_ptr_array_remove_index(priv->tags, i);
+			g_usb_device_bump_generation(self);
 			return;
 		}
 	}
@@ -841,6 +1091,216 @@ g_usb_device_async_not_open_error(GUsbDevice *self,
 				g_usb_device_get_pid(self));
 }
 
+/* a string descriptor is never longer than 255 bytes as bLength is a single byte */
+#define G_USB_DEVICE_STRING_DESCRIPTOR_MAX 0xff
+#define G_USB_DEVICE_STRING_DESCRIPTOR_KEY(idx, langid)                                           \
+	GUINT_TO_POINTER(((guint)(langid) << 8) | (guint)(idx))
+
+/* the whole descriptor is cached, so any shorter request can be served from it */
+GBytes *
+_g_usb_device_lookup_string_descriptor(GUsbDevice *self,
+				       guint8 desc_index,
+				       guint16 langid,
+				       gsize length)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	GBytes *bytes;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&priv->string_descriptors_mutex);
+
+	bytes = g_hash_table_lookup(priv->string_descriptors,
+				    G_USB_DEVICE_STRING_DESCRIPTOR_KEY(desc_index, langid));
+	if (bytes == NULL)
+		return NULL;
+	return g_bytes_new_from_bytes(bytes, 0, MIN(length, g_bytes_get_size(bytes)));
+}
+
+void
+_g_usb_device_add_string_descriptor(GUsbDevice *self,
+				    guint8 desc_index,
+				    guint16 langid,
+				    GBytes *bytes)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&priv->string_descriptors_mutex);
+	g_hash_table_insert(priv->string_descriptors,
+			    G_USB_DEVICE_STRING_DESCRIPTOR_KEY(desc_index, langid),
+			    g_bytes_ref(bytes));
+}
+
+static GBytes *
+g_usb_device_get_string_descriptor_cached(GUsbDevice *self,
+					  libusb_device_handle *handle,
+					  guint8 desc_index,
+					  guint16 langid,
+					  gsize length,
+					  gint *rc)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	guint8 buf[G_USB_DEVICE_STRING_DESCRIPTOR_MAX] = {0x0};
+	GBytes *bytes_slice;
+	g_autoptr(GBytes) bytes = NULL;
+
+	/* the whole descriptor is only read and kept when prefetching, so that otherwise the
+	 * device sees the same wLength as before */
+	if (!_g_usb_context_has_flag(priv->context,
+				     G_USB_CONTEXT_FLAGS_PREFETCH_STRING_DESCRIPTORS)) {
+		*rc = libusb_get_string_descriptor(handle, desc_index, langid, buf, length);
+		if (*rc < 0)
+			return NULL;
+		return g_bytes_new(buf, *rc);
+	}
+	bytes_slice = _g_usb_device_lookup_string_descriptor(self, desc_index, langid, length);
+	if (bytes_slice != NULL) {
+		*rc = (gint)g_bytes_get_size(bytes_slice);
+		return bytes_slice;
+	}
+	*rc = libusb_get_string_descriptor(handle, desc_index, langid, buf, sizeof(buf));
+	if (*rc < 0)
+		return NULL;
+	bytes = g_bytes_new(buf, *rc);
+	_g_usb_device_add_string_descriptor(self, desc_index, langid, bytes);
+	*rc = (gint)MIN(length, g_bytes_get_size(bytes));
+	return g_bytes_new_from_bytes(bytes, 0, *rc);
+}
+
+/* UTF-16LE, with anything outside of ASCII replaced, like libusb_get_string_descriptor_ascii() */
+gint
+_g_usb_device_string_descriptor_to_ascii(const guint8 *buf,
+					 gsize bufsz,
+					 guint8 *data,
+					 gsize length)
+{
+	gsize di = 0;
+
+	if (length == 0)
+		return LIBUSB_ERROR_INVALID_PARAM;
+	if (bufsz < 2 || buf[0] > bufsz || buf[1] != LIBUSB_DT_STRING)
+		return LIBUSB_ERROR_IO;
+	for (gsize si = 2; si + 1 < buf[0] && di < length - 1; si += 2) {
+		if ((buf[si] & 0x80) || buf[si + 1] != 0x0)
+			data[di++] = '?';
+		else
+			data[di++] = buf[si];
+	}
+	data[di] = '\0';
+	return (gint)di;
+}
+
+/* like libusb_get_string_descriptor_ascii(), but using the string descriptor cache */
+static gint
+g_usb_device_get_string_descriptor_ascii_cached(GUsbDevice *self,
+						libusb_device_handle *handle,
+						guint8 desc_index,
+						guint8 *data,
+						gsize length)
+{
+	const guint8 *buf;
+	gint rc = LIBUSB_SUCCESS;
+	gsize bufsz = 0;
+	guint16 langid;
+	g_autoptr(GBytes) langids = NULL;
+	g_autoptr(GBytes) str = NULL;
+
+	/* index 0 is the table of language IDs rather than a string */
+	if (desc_index == 0x0)
+		return LIBUSB_ERROR_INVALID_PARAM;
+
+	/* use the first language the device supports */
+	langids = g_usb_device_get_string_descriptor_cached(self,
+							    handle,
+							    0x0,
+							    0x0,
+							    G_USB_DEVICE_STRING_DESCRIPTOR_MAX,
+							    &rc);
+	if (langids == NULL)
+		return rc;
+	buf = g_bytes_get_data(langids, &bufsz);
+	if (bufsz < 4 || buf[0] < 4 || buf[1] != LIBUSB_DT_STRING)
+		return LIBUSB_ERROR_IO;
+	langid = buf[2] | (buf[3] << 8);
+
+	str = g_usb_device_get_string_descriptor_cached(self,
+							handle,
+							desc_index,
+							langid,
+							G_USB_DEVICE_STRING_DESCRIPTOR_MAX,
+							&rc);
+	if (str == NULL)
+		return rc;
+	buf = g_bytes_get_data(str, &bufsz);
+	return _g_usb_device_string_descriptor_to_ascii(buf, bufsz, data, length);
+}
+
+static void
+g_usb_device_prefetch_string_descriptors_cb(GTask *task,
+					    gpointer source_object,
+					    gpointer task_data,
+					    GCancellable *cancellable)
+{
+	GUsbDevice *self = G_USB_DEVICE(source_object);
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	struct libusb_config_descriptor *config = NULL;
+	g_autoptr(GByteArray) idxs = g_byte_array_new();
+
+	/* referenced by the device descriptor */
+	g_byte_array_append(idxs, &priv->desc.iManufacturer, 1);
+	g_byte_array_append(idxs, &priv->desc.iProduct, 1);
+	g_byte_array_append(idxs, &priv->desc.iSerialNumber, 1);
+
+	/* referenced by the active configuration and its interfaces */
+	if (libusb_get_active_config_descriptor(priv->device, &config) == LIBUSB_SUCCESS) {
+		g_byte_array_append(idxs, &config->iConfiguration, 1);
+		for (guint i = 0; i < config->bNumInterfaces; i++) {
+			const struct libusb_interface *iface = &config->interface[i];
+			for (gint j = 0; j < iface->num_altsetting; j++)
+				g_byte_array_append(idxs, &iface->altsetting[j].iInterface, 1);
+		}
+		libusb_free_config_descriptor(config);
+	}
+
+	/* g_usb_device_close() cancels and then waits for the handle to be released */
+	g_mutex_lock(&priv->prefetch_mutex);
+	for (guint i = 0; i < idxs->len; i++) {
+		guint8 buf[128];
+		if (g_cancellable_is_cancelled(cancellable))
+			break;
+		if (idxs->data[i] == 0x0)
+			continue;
+		g_usb_device_get_string_descriptor_ascii_cached(self,
+								priv->handle,
+								idxs->data[i],
+								buf,
+								sizeof(buf));
+	}
+	g_mutex_unlock(&priv->prefetch_mutex);
+	g_task_return_boolean(task, TRUE);
+}
+
+static void
+g_usb_device_prefetch_string_descriptors(GUsbDevice *self)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GTask) task = NULL;
+
+	g_clear_object(&priv->prefetch_cancellable);
+	priv->prefetch_cancellable = g_cancellable_new();
+	task = g_task_new(self, priv->prefetch_cancellable, NULL, NULL);
+	g_task_run_in_thread(task, g_usb_device_prefetch_string_descriptors_cb);
+}
+
+static void
+g_usb_device_prefetch_string_descriptors_cancel(GUsbDevice *self)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+
+	if (priv->prefetch_cancellable == NULL)
+		return;
+	g_cancellable_cancel(priv->prefetch_cancellable);
+	g_mutex_lock(&priv->prefetch_mutex);
+	g_mutex_unlock(&priv->prefetch_mutex);
+	g_clear_object(&priv->prefetch_cancellable);
+}
+
 gboolean
 _g_usb_device_open_internal(GUsbDevice *self, GError **error)
 {
@@ -870,6 +1330,10 @@ _g_usb_device_open_internal(GUsbDevice *self, GError **error)
 		return FALSE;
 	}
 
+	/* read the strings in the background so that later requests hit the cache */
+	if (_g_usb_context_has_flag(priv->context, G_USB_CONTEXT_FLAGS_PREFETCH_STRING_DESCRIPTORS))
+		g_usb_device_prefetch_string_descriptors(self);
+
 	/* success */
 	return TRUE;
 }
@@ -897,7 +1361,7 @@ g_usb_device_open(GUsbDevice *self, GError **error)
 
 	/* emulated */
 	if (priv->device == NULL)
-		return TRUE;
+		return g_usb_device_ensure_loaded(self, error);
 
 	/* ignore */
 	if (g_usb_context_get_flags(priv->context) & G_USB_CONTEXT_FLAGS_AUTO_OPEN_DEVICES)
@@ -907,17 +1371,39 @@ g_usb_device_open(GUsbDevice *self, GError **error)
 	return _g_usb_device_open_internal(self, error);
 }
 
+/* transfer none */
+static GUsbDeviceEvent *
+g_usb_device_consume_event(GUsbDevice *self, guint idx)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	GUsbDeviceEvent *event = g_ptr_array_index(priv->events, idx);
+	guint rep = idx == priv->event_idx ? priv->event_rep + 1 : 1;
+
+	/* stay on a repeated event until every repetition has been used */
+	if (rep < g_usb_device_event_get_repeat(event)) {
+		priv->event_idx = idx;
+		priv->event_rep = rep;
+	} else {
+		priv->event_idx = idx + 1;
+		priv->event_rep = 0;
+	}
+	return event;
+}
+
 /* transfer none */
 static GUsbDeviceEvent *
 g_usb_device_load_event(GUsbDevice *self, const gchar *id)
 {
 	GUsbDevicePrivate *priv = GET_PRIVATE(self);
 
+	g_usb_device_ensure_loaded_or_warn(self);
+
 	/* reset back to the beginning */
 	if (priv->event_idx >= priv->events->len) {
 		if (_g_usb_context_has_flag(priv->context, G_USB_CONTEXT_FLAGS_DEBUG))
 			g_debug("resetting event index");
 		priv->event_idx = 0;
+		priv->event_rep = 0;
 	}
 
 	/* look for the next event in the sequence */
@@ -926,8 +1412,7 @@ g_usb_device_load_event(GUsbDevice *self, const gchar *id)
 		if (g_strcmp0(g_usb_device_event_get_id(event), id) == 0) {
 			if (_g_usb_context_has_flag(priv->context, G_USB_CONTEXT_FLAGS_DEBUG))
 				g_debug("found in-order %s at position %u", id, i);
-			priv->event_idx = i + 1;
-			return event;
+			return g_usb_device_consume_event(self, i);
 		}
 	}
 
@@ -937,8 +1422,7 @@ g_usb_device_load_event(GUsbDevice *self, const gchar *id)
 		if (g_strcmp0(g_usb_device_event_get_id(event), id) == 0) {
 			if (_g_usb_context_has_flag(priv->context, G_USB_CONTEXT_FLAGS_DEBUG))
 				g_debug("found out-of-order %s at position %u", id, i);
-			priv->event_idx = i + 1;
-			return event;
+			return g_usb_device_consume_event(self, i);
 		}
 	}
 
@@ -959,9 +1443,87 @@ g_usb_device_save_event(GUsbDevice *self, const gchar *id)
 	/* success */
 	event = _g_usb_device_event_new(id);
 	g_ptr_array_add(priv->events, event);
+	g_usb_device_bump_generation(self);
 	return event;
 }
 
+#define G_USB_DEVICE_CUSTOM_INDEX_KEY(class_id, subclass_id, protocol_id)                          \
+	GUINT_TO_POINTER(((guint)(class_id) << 16) | ((guint)(subclass_id) << 8) | (protocol_id))
+
+/* the first alternate setting of each interface, where the first interface to match wins */
+static GHashTable *
+g_usb_device_ensure_custom_indexes(GUsbDevice *self, GError **error)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GPtrArray) interfaces = NULL;
+
+	if (priv->custom_indexes != NULL)
+		return priv->custom_indexes;
+	interfaces = g_usb_device_get_interfaces(self, error);
+	if (interfaces == NULL)
+		return NULL;
+	priv->custom_indexes = g_hash_table_new(g_direct_hash, g_direct_equal);
+	for (guint i = 0; i < interfaces->len; i++) {
+		GUsbInterface *intf = g_ptr_array_index(interfaces, i);
+		gpointer key;
+		if (g_usb_interface_get_alternate(intf) != 0)
+			continue;
+		key = G_USB_DEVICE_CUSTOM_INDEX_KEY(g_usb_interface_get_class(intf),
+						    g_usb_interface_get_subclass(intf),
+						    g_usb_interface_get_protocol(intf));
+		if (g_hash_table_contains(priv->custom_indexes, key))
+			continue;
+		g_hash_table_insert(priv->custom_indexes,
+				    key,
+				    GUINT_TO_POINTER(g_usb_interface_get_index(intf)));
+	}
+	return priv->custom_indexes;
+}
+
+/* uses the interfaces rather than the events, so also works for emulated devices */
+guint8
+_g_usb_device_lookup_custom_index(GUsbDevice *self,
+				  guint8 class_id,
+				  guint8 subclass_id,
+				  guint8 protocol_id,
+				  GError **error)
+{
+	GHashTable *custom_indexes;
+	gpointer key = G_USB_DEVICE_CUSTOM_INDEX_KEY(class_id, subclass_id, protocol_id);
+	gpointer value = NULL;
+
+	custom_indexes = g_usb_device_ensure_custom_indexes(self, error);
+	if (custom_indexes == NULL)
+		return 0x00;
+	if (!g_hash_table_lookup_extended(custom_indexes, key, NULL, &value) ||
+	    GPOINTER_TO_UINT(value) == 0x00) {
+		g_set_error(error,
+			    G_USB_DEVICE_ERROR,
+			    G_USB_DEVICE_ERROR_NOT_SUPPORTED,
+			    "no vendor descriptor for class 0x%02x, "
+			    "subclass 0x%02x and protocol 0x%02x",
+			    class_id,
+			    subclass_id,
+			    protocol_id);
+		return 0x00;
+	}
+	return GPOINTER_TO_UINT(value);
+}
+
+/* identical payloads are shared by all the devices in the context */
+static void
+g_usb_device_set_event_data(GUsbDevice *self,
+			    GUsbDeviceEvent *event,
+			    gconstpointer buf,
+			    gsize bufsz)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	g_autoptr(GBytes) bytes = g_bytes_new(buf, bufsz);
+	g_autoptr(GBytes) bytes_shared = _g_usb_context_intern_bytes(priv->context, bytes);
+	g_usb_device_event_set_bytes(event, bytes_shared);
+	g_usb_device_bump_generation(self);
+}
+
 /**
  * g_usb_device_get_custom_index:
  * @self: a #GUsbDevice
@@ -985,10 +1547,7 @@ g_usb_device_get_custom_index(GUsbDevice *self,
 {
 	GUsbDevicePrivate *priv = GET_PRIVATE(self);
 	GUsbDeviceEvent *event;
-	const struct libusb_interface_descriptor *ifp;
-	gint rc;
-	guint8 idx = 0x00;
-	struct libusb_config_descriptor *config;
+	guint8 idx;
 	g_autofree gchar *event_id = NULL;
 
 	/* build event key either for load or save */
@@ -1029,41 +1588,17 @@ g_usb_device_get_custom_index(GUsbDevice *self,
 		return ((const guint8 *)g_bytes_get_data(bytes, NULL))[0];
 	}
 
-	rc = libusb_get_active_config_descriptor(priv->device, &config);
-	if (!g_usb_device_libusb_error_to_gerror(self, rc, error))
+	/* find the right data, without parsing the config descriptor again */
+	idx = _g_usb_device_lookup_custom_index(self, class_id, subclass_id, protocol_id, error);
+	if (idx == 0x00)
 		return 0x00;
 
-	/* find the right data */
-	for (guint i = 0; i < config->bNumInterfaces; i++) {
-		ifp = &config->interface[i].altsetting[0];
-		if (ifp->bInterfaceClass != class_id)
-			continue;
-		if (ifp->bInterfaceSubClass != subclass_id)
-			continue;
-		if (ifp->bInterfaceProtocol != protocol_id)
-			continue;
-		idx = ifp->iInterface;
-		break;
-	}
-
-	/* nothing matched */
-	if (idx == 0x00) {
-		g_set_error(error,
-			    G_USB_DEVICE_ERROR,
-			    G_USB_DEVICE_ERROR_NOT_SUPPORTED,
-			    "no vendor descriptor for class 0x%02x, "
-			    "subclass 0x%02x and protocol 0x%02x",
-			    class_id,
-			    subclass_id,
-			    protocol_id);
-
-	} else if (g_usb_context_get_flags(priv->context) & G_USB_CONTEXT_FLAGS_SAVE_EVENTS) {
-		/* save */
+	/* save */
+	if (g_usb_context_get_flags(priv->context) & G_USB_CONTEXT_FLAGS_SAVE_EVENTS) {
 		event = g_usb_device_save_event(self, event_id);
-		_g_usb_device_event_set_bytes_raw(event, &idx, sizeof(idx));
+		g_usb_device_set_event_data(self, event, &idx, sizeof(idx));
 	}
 
-	libusb_free_config_descriptor(config);
 	return idx;
 }
 
@@ -1146,6 +1681,9 @@ g_usb_device_get_interfaces(GUsbDevice *self, GError **error)
 	g_return_val_if_fail(G_USB_IS_DEVICE(self), NULL);
 	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
 
+	if (!g_usb_device_ensure_loaded(self, error))
+		return NULL;
+
 	/* get all interfaces */
 	if (!priv->interfaces_valid) {
 		gint rc;
@@ -1180,6 +1718,21 @@ g_usb_device_get_interfaces(GUsbDevice *self, GError **error)
 	return g_ptr_array_ref(priv->interfaces);
 }
 
+/* only physical devices are cached, as emulated devices already have all the descriptors */
+static gchar *
+g_usb_device_get_descriptor_cache_key(GUsbDevice *self)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	if (priv->device == NULL)
+		return NULL;
+	if (!_g_usb_context_has_flag(priv->context, G_USB_CONTEXT_FLAGS_CACHE_DESCRIPTORS))
+		return NULL;
+	return g_strdup_printf("%04x:%04x:%04x",
+			       priv->desc.idVendor,
+			       priv->desc.idProduct,
+			       priv->desc.bcdDevice);
+}
+
 /**
  * g_usb_device_get_events:
  * @self: a #GUsbDevice
@@ -1198,6 +1751,7 @@ g_usb_device_get_events(GUsbDevice *self)
 {
 	GUsbDevicePrivate *priv = GET_PRIVATE(self);
 	g_return_val_if_fail(G_USB_IS_DEVICE(self), NULL);
+	g_usb_device_ensure_loaded_or_warn(self);
 	return g_ptr_array_ref(priv->events);
 }
 
@@ -1214,15 +1768,18 @@ g_usb_device_clear_events(GUsbDevice *self)
 {
 	GUsbDevicePrivate *priv = GET_PRIVATE(self);
 	g_return_if_fail(G_USB_IS_DEVICE(self));
+	g_usb_device_ensure_loaded_or_warn(self);
 	priv->event_idx = 0;
+	priv->event_rep = 0;
 	g_ptr_array_set_size(priv->events, 0);
+	g_usb_device_bump_generation(self);
 }
 
 /**
  * g_usb_device_invalidate:
  * @self: a #GUsbDevice
  *
- * Invalidates the caches used in g_usb_device_get_interfaces().
+ * Invalidates the caches used in g_usb_device_get_interfaces() and for string descriptors.
  *
  * Since: 0.4.0
  **/
@@ -1230,12 +1787,63 @@ void
 g_usb_device_invalidate(GUsbDevice *self)
 {
 	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	g_autofree gchar *cache_key = NULL;
+
 	g_return_if_fail(G_USB_IS_DEVICE(self));
+	g_usb_device_ensure_loaded_or_warn(self);
+
+	/* the device may have new firmware with the same bcdDevice */
+	cache_key = g_usb_device_get_descriptor_cache_key(self);
+	if (cache_key != NULL)
+		_g_usb_context_remove_cached_descriptors(priv->context, cache_key);
 	priv->interfaces_valid = FALSE;
 	priv->bos_descriptors_valid = FALSE;
+	g_clear_pointer(&priv->custom_indexes, g_hash_table_unref);
 	g_ptr_array_set_size(priv->interfaces, 0);
 	g_ptr_array_set_size(priv->bos_descriptors, 0);
 	g_ptr_array_set_size(priv->hid_descriptors, 0);
+
+	/* a running prefetch would put the old strings back */
+	g_usb_device_prefetch_string_descriptors_cancel(self);
+	g_mutex_lock(&priv->string_descriptors_mutex);
+	g_hash_table_remove_all(priv->string_descriptors);
+	g_mutex_unlock(&priv->string_descriptors_mutex);
+	g_usb_device_bump_generation(self);
+}
+
+/* takes the tags, descriptors and events of @donor, which was loaded from a delta */
+void
+_g_usb_device_replace_state(GUsbDevice *self, GUsbDevice *donor)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	GUsbDevicePrivate *priv_donor = GET_PRIVATE(donor);
+
+	g_return_if_fail(G_USB_IS_DEVICE(self));
+	g_return_if_fail(G_USB_IS_DEVICE(donor));
+
+	g_usb_device_ensure_loaded_or_warn(donor);
+	g_usb_device_invalidate(self);
+	g_ptr_array_set_size(priv->tags, 0);
+	for (guint i = 0; i < priv_donor->tags->len; i++)
+		g_ptr_array_add(priv->tags, g_strdup(g_ptr_array_index(priv_donor->tags, i)));
+	for (guint i = 0; i < priv_donor->interfaces->len; i++)
+		g_ptr_array_add(priv->interfaces,
+				g_object_ref(g_ptr_array_index(priv_donor->interfaces, i)));
+	for (guint i = 0; i < priv_donor->bos_descriptors->len; i++)
+		g_ptr_array_add(priv->bos_descriptors,
+				g_object_ref(g_ptr_array_index(priv_donor->bos_descriptors, i)));
+	for (guint i = 0; i < priv_donor->hid_descriptors->len; i++)
+		g_ptr_array_add(priv->hid_descriptors,
+				g_bytes_ref(g_ptr_array_index(priv_donor->hid_descriptors, i)));
+	priv->interfaces_valid = priv_donor->interfaces_valid;
+	priv->bos_descriptors_valid = priv_donor->bos_descriptors_valid;
+	priv->hid_descriptors_valid = priv_donor->hid_descriptors_valid;
+	g_ptr_array_set_size(priv->events, 0);
+	for (guint i = 0; i < priv_donor->events->len; i++)
+		g_ptr_array_add(priv->events,
+				g_object_ref(g_ptr_array_index(priv_donor->events, i)));
+	priv->event_idx = 0;
+	priv->event_rep = 0;
 }
 
 /**
@@ -1279,6 +1887,26 @@ g_usb_device_get_bos_descriptor(GUsbDevice *self, guint8 capability, GError **er
 	return NULL;
 }
 
+static gboolean
+g_usb_device_cache_bos_descriptors(GUsbDevice *self, const gchar *cache_key, GError **error)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	g_autoptr(JsonBuilder) json_builder = json_builder_new();
+
+	json_builder_begin_array(json_builder);
+	for (guint i = 0; i < priv->bos_descriptors->len; i++) {
+		GUsbBosDescriptor *bos_descriptor = g_ptr_array_index(priv->bos_descriptors, i);
+		if (!_g_usb_bos_descriptor_save(bos_descriptor, json_builder, error))
+			return FALSE;
+	}
+	json_builder_end_array(json_builder);
+	_g_usb_context_set_cached_descriptors(priv->context,
+					      cache_key,
+					      "UsbBosDescriptors",
+					      json_builder_get_root(json_builder));
+	return TRUE;
+}
+
 /**
  * g_usb_device_get_bos_descriptors:
  * @self: a #GUsbDevice
@@ -1301,11 +1929,16 @@ g_usb_device_get_bos_descriptors(GUsbDevice *self, GError **error)
 	g_return_val_if_fail(G_USB_IS_DEVICE(self), NULL);
 	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
 
+	if (!g_usb_device_ensure_loaded(self, error))
+		return NULL;
+
 	/* get all BOS descriptors */
 	if (!priv->bos_descriptors_valid) {
 		gint rc;
 		guint8 num_device_caps;
 		struct libusb_bos_descriptor *bos = NULL;
+		g_autofree gchar *cache_key = NULL;
+		g_autoptr(JsonNode) json_node = NULL;
 
 		/* sanity check */
 		if (priv->device == NULL) {
@@ -1315,6 +1948,25 @@ g_usb_device_get_bos_descriptors(GUsbDevice *self, GError **error)
 					    "not supported for emulated device");
 			return NULL;
 		}
+
+		/* seen before, so the device does not need to be opened */
+		cache_key = g_usb_device_get_descriptor_cache_key(self);
+		if (cache_key != NULL)
+			json_node = _g_usb_context_get_cached_descriptors(priv->context,
+									  cache_key,
+									  "UsbBosDescriptors");
+		if (json_node != NULL) {
+			g_autoptr(GError) error_local = NULL;
+			if (g_usb_device_load_bos_descriptors(self,
+							      json_node_get_array(json_node),
+							      &error_local)) {
+				priv->bos_descriptors_valid = TRUE;
+				return g_ptr_array_ref(priv->bos_descriptors);
+			}
+			g_debug("ignoring cached BOS descriptors: %s", error_local->message);
+			g_ptr_array_set_size(priv->bos_descriptors, 0);
+		}
+
 		if (priv->handle == NULL) {
 			g_usb_device_not_open_error(self, error);
 			return NULL;
@@ -1345,6 +1997,15 @@ g_usb_device_get_bos_descriptors(GUsbDevice *self, GError **error)
 		}
 		libusb_free_bos_descriptor(bos);
 		priv->bos_descriptors_valid = TRUE;
+
+		/* for the next device with the same firmware, which is not required to succeed */
+		if (cache_key != NULL) {
+			g_autoptr(GError) error_local = NULL;
+			if (!g_usb_device_cache_bos_descriptors(self, cache_key, &error_local)) {
+				g_debug("failed to cache BOS descriptors: %s",
+					error_local->message);
+			}
+		}
 	}
 
 	/* success */
@@ -1460,8 +2121,14 @@ g_usb_device_get_hid_descriptors(GUsbDevice *self, GError **error)
 	g_return_val_if_fail(G_USB_IS_DEVICE(self), NULL);
 	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
 
+	if (!g_usb_device_ensure_loaded(self, error))
+		return NULL;
+
 	/* sanity check */
 	if (!priv->hid_descriptors_valid) {
+		g_autofree gchar *cache_key = NULL;
+		g_autoptr(JsonNode) json_node = NULL;
+
 		if (priv->device == NULL) {
 			g_set_error_literal(error,
 					    G_IO_ERROR,
@@ -1469,6 +2136,19 @@ g_usb_device_get_hid_descriptors(GUsbDevice *self, GError **error)
 					    "not supported for emulated device");
 			return NULL;
 		}
+
+		/* seen before, so the device does not need to be opened */
+		cache_key = g_usb_device_get_descriptor_cache_key(self);
+		if (cache_key != NULL)
+			json_node = _g_usb_context_get_cached_descriptors(priv->context,
+									  cache_key,
+									  "UsbHidDescriptors");
+		if (json_node != NULL) {
+			g_usb_device_load_hid_descriptors(self, json_node_get_array(json_node));
+			priv->hid_descriptors_valid = TRUE;
+			return g_ptr_array_ref(priv->hid_descriptors);
+		}
+
 		if (priv->handle == NULL) {
 			g_usb_device_not_open_error(self, error);
 			return NULL;
@@ -1488,6 +2168,16 @@ g_usb_device_get_hid_descriptors(GUsbDevice *self, GError **error)
 			g_ptr_array_add(priv->hid_descriptors, g_steal_pointer(&blob));
 		}
 		priv->hid_descriptors_valid = TRUE;
+
+		/* for the next device with the same firmware */
+		if (cache_key != NULL) {
+			g_autoptr(JsonBuilder) json_builder = json_builder_new();
+			g_usb_device_save_hid_descriptors(priv->hid_descriptors, json_builder);
+			_g_usb_context_set_cached_descriptors(priv->context,
+							      cache_key,
+							      "UsbHidDescriptors",
+							      json_builder_get_root(json_builder));
+		}
 	}
 
 	/* success */
@@ -1560,6 +2250,7 @@ g_usb_device_close(GUsbDevice *self, GError **error)
 	if (priv->handle == NULL)
 		return g_usb_device_not_open_error(self, error);
 
+	g_usb_device_prefetch_string_descriptors_cancel(self);
 	libusb_close(priv->handle);
 	priv->handle = NULL;
 	return TRUE;
@@ -1685,7 +2376,14 @@ g_usb_device_set_configuration(GUsbDevice *self, gint configuration, GError **er
 
 	/* different, so change */
 	rc = libusb_set_configuration(priv->handle, configuration);
-	return g_usb_device_libusb_error_to_gerror(self, rc, error);
+	if (!g_usb_device_libusb_error_to_gerror(self, rc, error))
+		return FALSE;
+
+	/* the interfaces are from the active configuration */
+	priv->interfaces_valid = FALSE;
+	g_clear_pointer(&priv->custom_indexes, g_hash_table_unref);
+	g_ptr_array_set_size(priv->interfaces, 0);
+	return TRUE;
 }
 
 /**
@@ -1834,7 +2532,7 @@ g_usb_device_get_string_descriptor(GUsbDevice *self, guint8 desc_index, GError *
 	GUsbDeviceEvent *event;
 	gint rc;
 	/* libusb_get_string_descriptor_ascii returns max 128 bytes */
-	unsigned char buf[128];
+	guint8 buf[128] = {0x0};
 	g_autofree gchar *event_id = NULL;
 
 	g_return_val_if_fail(G_USB_IS_DEVICE(self), NULL);
@@ -1878,7 +2576,11 @@ g_usb_device_get_string_descriptor(GUsbDevice *self, guint8 desc_index, GError *
 		return NULL;
 	}
 
-	rc = libusb_get_string_descriptor_ascii(priv->handle, desc_index, buf, sizeof(buf));
+	rc = g_usb_device_get_string_descriptor_ascii_cached(self,
+							     priv->handle,
+							     desc_index,
+							     buf,
+							     sizeof(buf));
 	if (rc < 0) {
 		g_usb_device_libusb_error_to_gerror(self, rc, error);
 		return NULL;
@@ -1887,7 +2589,7 @@ g_usb_device_get_string_descriptor(GUsbDevice *self, guint8 desc_index, GError *
 	/* save */
 	if (g_usb_context_get_flags(priv->context) & G_USB_CONTEXT_FLAGS_SAVE_EVENTS) {
 		event = g_usb_device_save_event(self, event_id);
-		_g_usb_device_event_set_bytes_raw(event, buf, sizeof(buf));
+		g_usb_device_set_event_data(self, event, buf, sizeof(buf));
 	}
 
 	return g_strdup((const gchar *)buf);
@@ -1903,6 +2605,10 @@ g_usb_device_get_string_descriptor(GUsbDevice *self, guint8 desc_index, GError *
  * Get a raw string descriptor from the device. The returned string should be freed
  * with g_bytes_unref() when no longer needed.
  *
+ * If the context has %G_USB_CONTEXT_FLAGS_PREFETCH_STRING_DESCRIPTORS set then the whole
+ * descriptor is read once with a length of 255 and cached, and a shorter @length is served from
+ * the cached copy.
+ *
  * Return value: (transfer full): a possibly UTF-16 string, or NULL on error.
  *
  * Since: 0.3.8
@@ -1916,8 +2622,8 @@ g_usb_device_get_string_descriptor_bytes_full(GUsbDevice *self,
 {
 	GUsbDevicePrivate *priv = GET_PRIVATE(self);
 	GUsbDeviceEvent *event;
-	gint rc;
-	g_autofree guint8 *buf = g_malloc0(length);
+	gint rc = LIBUSB_SUCCESS;
+	g_autoptr(GBytes) bytes = NULL;
 	g_autofree gchar *event_id = NULL;
 
 	g_return_val_if_fail(G_USB_IS_DEVICE(self), NULL);
@@ -1966,7 +2672,20 @@ g_usb_device_get_string_descriptor_bytes_full(GUsbDevice *self,
 		return NULL;
 	}
 
-	rc = libusb_get_string_descriptor(priv->handle, desc_index, langid, buf, length);
+	/* nothing to cache when asking for more than any descriptor can hold */
+	if (length > G_USB_DEVICE_STRING_DESCRIPTOR_MAX) {
+		g_autofree guint8 *buf = g_malloc0(length);
+		rc = libusb_get_string_descriptor(priv->handle, desc_index, langid, buf, length);
+		if (rc >= 0)
+			bytes = g_bytes_new(buf, rc);
+	} else {
+		bytes = g_usb_device_get_string_descriptor_cached(self,
+								  priv->handle,
+								  desc_index,
+								  langid,
+								  length,
+								  &rc);
+	}
 	if (rc < 0) {
 		g_usb_device_libusb_error_to_gerror(self, rc, error);
 		return NULL;
@@ -1975,10 +2694,13 @@ g_usb_device_get_string_descriptor_bytes_full(GUsbDevice *self,
 	/* save */
 	if (g_usb_context_get_flags(priv->context) & G_USB_CONTEXT_FLAGS_SAVE_EVENTS) {
 		event = g_usb_device_save_event(self, event_id);
-		_g_usb_device_event_set_bytes_raw(event, buf, rc);
+		g_usb_device_set_event_data(self,
+					    event,
+					    g_bytes_get_data(bytes, NULL),
+					    g_bytes_get_size(bytes));
 	}
 
-	return g_bytes_new(buf, rc);
+	return g_steal_pointer(&bytes);
 }
 
 /**
@@ -2303,9 +3025,10 @@ g_usb_device_async_transfer_cb(struct libusb_transfer *transfer)
 		g_task_return_error(task, error);
 	} else {
 		if (req->event != NULL) {
-			_g_usb_device_event_set_bytes_raw(req->event,
-							  transfer->buffer,
-							  (gsize)transfer->actual_length);
+			g_usb_device_set_event_data(g_task_get_source_object(task),
+						    req->event,
+						    transfer->buffer,
+						    (gsize)transfer->actual_length);
 		}
 		g_task_return_int(task, transfer->actual_length);
 	}
@@ -2338,10 +3061,10 @@ g_usb_device_control_transfer_cb(struct libusb_transfer *transfer)
 			transfer->buffer + LIBUSB_CONTROL_SETUP_SIZE,
 			(gsize)transfer->actual_length);
 		if (req->event != NULL) {
-			_g_usb_device_event_set_bytes_raw(req->event,
-							  transfer->buffer +
-							      LIBUSB_CONTROL_SETUP_SIZE,
-							  (gsize)transfer->actual_length);
+			g_usb_device_set_event_data(g_task_get_source_object(task),
+						    req->event,
+						    transfer->buffer + LIBUSB_CONTROL_SETUP_SIZE,
+						    (gsize)transfer->actual_length);
 		}
 		g_task_return_int(task, transfer->actual_length);
 	}
@@ -2374,6 +3097,87 @@ gusb_memcpy_bytes_safe(guint8 *dst, gsize dstsz, GBytes *bytes, GError **error)
 	return TRUE;
 }
 
+typedef struct {
+	guint8 *data; /* owned by the user */
+	gsize length;
+	GUsbDeviceEvent *event;
+} GUsbDeviceEmulateReq;
+
+static void
+g_usb_device_emulate_req_free(GUsbDeviceEmulateReq *req)
+{
+	g_object_unref(req->event);
+	g_free(req);
+}
+
+/* run from the context idle source */
+static void
+g_usb_device_emulate_transfer_cb(GTask *task)
+{
+	GUsbDevice *self = g_task_get_source_object(task);
+	GUsbDeviceEmulateReq *req = g_task_get_task_data(task);
+	GBytes *bytes;
+	GError *error = NULL;
+
+	if (!g_usb_device_libusb_error_to_gerror(self,
+						 g_usb_device_event_get_rc(req->event),
+						 &error) ||
+	    !g_usb_device_libusb_status_to_gerror(g_usb_device_event_get_status(req->event),
+						  &error)) {
+		g_task_return_error(task, error);
+		return;
+	}
+	bytes = g_usb_device_event_get_bytes(req->event);
+	if (bytes == NULL) {
+		g_task_return_new_error(task,
+					G_IO_ERROR,
+					G_IO_ERROR_INVALID_DATA,
+					"no matching event data for %s",
+					g_usb_device_event_get_id(req->event));
+		return;
+	}
+	if (!gusb_memcpy_bytes_safe(req->data, req->length, bytes, &error)) {
+		g_task_return_error(task, error);
+		return;
+	}
+	g_task_return_int(task, g_bytes_get_size(bytes));
+}
+
+/* the event is matched now so that the replay order is the submission order */
+static void
+g_usb_device_emulate_transfer_async(GUsbDevice *self,
+				    const gchar *event_id,
+				    guint8 *data,
+				    gsize length,
+				    gpointer source_tag,
+				    GCancellable *cancellable,
+				    GAsyncReadyCallback callback,
+				    gpointer user_data)
+{
+	GUsbDevicePrivate *priv = GET_PRIVATE(self);
+	GUsbDeviceEmulateReq *req;
+	GUsbDeviceEvent *event;
+	g_autoptr(GTask) task = NULL;
+
+	task = g_task_new(self, cancellable, callback, user_data);
+	g_task_set_source_tag(task, source_tag);
+	event = g_usb_device_load_event(self, event_id);
+	if (event == NULL) {
+		g_task_return_new_error(task,
+					G_IO_ERROR,
+					G_IO_ERROR_INVALID_DATA,
+					"no matching event for %s",
+					event_id);
+		return;
+	}
+	req = g_new0(GUsbDeviceEmulateReq, 1);
+	req->data = data;
+	req->length = length;
+	req->event = g_object_ref(event);
+	g_task_set_task_data(task, req, (GDestroyNotify)g_usb_device_emulate_req_free);
+	_g_usb_context_emulate_task(priv->context, task, g_usb_device_emulate_transfer_cb);
+}
+
 /**
  * g_usb_device_control_transfer_async:
  * @self: a #GUsbDevice
@@ -2442,54 +3246,14 @@ g_usb_device_control_transfer_async(GUsbDevice *self,
 
 	/* emulated */
 	if (priv->device == NULL) {
-		GBytes *bytes;
-		event = g_usb_device_load_event(self, event_id);
-		if (event == NULL) {
-			g_task_report_new_error(self,
-						callback,
-						user_data,
-						g_usb_device_control_transfer_async,
-						G_IO_ERROR,
-						G_IO_ERROR_INVALID_DATA,
-						"no matching event for %s",
-						event_id);
-			return;
-		}
-		if (!g_usb_device_libusb_error_to_gerror(self,
-							 g_usb_device_event_get_rc(event),
-							 &error) ||
-		    !g_usb_device_libusb_status_to_gerror(g_usb_device_event_get_status(event),
-							  &error)) {
-			g_task_report_error(self,
-					    callback,
-					    user_data,
-					    g_usb_device_control_transfer_async,
-					    error);
-			return;
-		}
-		bytes = g_usb_device_event_get_bytes(event);
-		if (bytes == NULL) {
-			g_task_report_new_error(self,
-						callback,
-						user_data,
-						g_usb_device_control_transfer_async,
-						G_IO_ERROR,
-						G_IO_ERROR_INVALID_DATA,
-						"no matching event data for %s",
-						event_id);
-			return;
-		}
-		if (!gusb_memcpy_bytes_safe(data, length, bytes, &error)) {
-			g_task_report_error(self,
-					    callback,
-					    user_data,
-					    g_usb_device_control_transfer_async,
-					    error);
-			return;
-		}
-		task = g_task_new(self, cancellable, callback, user_data);
-		g_task_return_int(task, g_bytes_get_size(bytes));
-		g_object_unref(task);
+		g_usb_device_emulate_transfer_async(self,
+						    event_id,
+						    data,
+						    length,
+						    g_usb_device_control_transfer_async,
+						    cancellable,
+						    callback,
+						    user_data);
 		return;
 	}
 
@@ -2633,54 +3397,14 @@ g_usb_device_bulk_transfer_async(GUsbDevice *self,
 
 	/* emulated */
 	if (priv->device == NULL) {
-		GBytes *bytes;
-		event = g_usb_device_load_event(self, event_id);
-		if (event == NULL) {
-			g_task_report_new_error(self,
-						callback,
-						user_data,
-						g_usb_device_control_transfer_async,
-						G_IO_ERROR,
-						G_IO_ERROR_INVALID_DATA,
-						"no matching event for %s",
-						event_id);
-			return;
-		}
-		if (!g_usb_device_libusb_error_to_gerror(self,
-							 g_usb_device_event_get_rc(event),
-							 &error) ||
-		    !g_usb_device_libusb_status_to_gerror(g_usb_device_event_get_status(event),
-							  &error)) {
-			g_task_report_error(self,
-					    callback,
-					    user_data,
-					    g_usb_device_control_transfer_async,
-					    error);
-			return;
-		}
-		bytes = g_usb_device_event_get_bytes(event);
-		if (bytes == NULL) {
-			g_task_report_new_error(self,
-						callback,
-						user_data,
-						g_usb_device_control_transfer_async,
-						G_IO_ERROR,
-						G_IO_ERROR_INVALID_DATA,
-						"no matching event data for %s",
-						event_id);
-			return;
-		}
-		if (!gusb_memcpy_bytes_safe(data, length, bytes, &error)) {
-			g_task_report_error(self,
-					    callback,
-					    user_data,
-					    g_usb_device_control_transfer_async,
-					    error);
-			return;
-		}
-		task = g_task_new(self, cancellable, callback, user_data);
-		g_task_return_int(task, g_bytes_get_size(bytes));
-		g_object_unref(task);
+		g_usb_device_emulate_transfer_async(self,
+						    event_id,
+						    data,
+						    length,
+						    g_usb_device_bulk_transfer_async,
+						    cancellable,
+						    callback,
+						    user_data);
 		return;
 	}
 
@@ -2813,54 +3537,14 @@ g_usb_device_interrupt_transfer_async(GUsbDevice *self,
 
 	/* emulated */
 	if (priv->device == NULL) {
-		GBytes *bytes;
-		event = g_usb_device_load_event(self, event_id);
-		if (event == NULL) {
-			g_task_report_new_error(self,
-						callback,
-						user_data,
-						g_usb_device_interrupt_transfer_async,
-						G_IO_ERROR,
-						G_IO_ERROR_INVALID_DATA,
-						"no matching event for %s",
-						event_id);
-			return;
-		}
-		if (!g_usb_device_libusb_error_to_gerror(self,
-							 g_usb_device_event_get_rc(event),
-							 &error) ||
-		    !g_usb_device_libusb_status_to_gerror(g_usb_device_event_get_status(event),
-							  &error)) {
-			g_task_report_error(self,
-					    callback,
-					    user_data,
-					    g_usb_device_control_transfer_async,
-					    error);
-			return;
-		}
-		bytes = g_usb_device_event_get_bytes(event);
-		if (bytes == NULL) {
-			g_task_report_new_error(self,
-						callback,
-						user_data,
-						g_usb_device_interrupt_transfer_async,
-						G_IO_ERROR,
-						G_IO_ERROR_INVALID_DATA,
-						"no matching event data for %s",
-						event_id);
-			return;
-		}
-		if (!gusb_memcpy_bytes_safe(data, length, bytes, &error)) {
-			g_task_report_error(self,
-					    callback,
-					    user_data,
-					    g_usb_device_control_transfer_async,
-					    error);
-			return;
-		}
-		task = g_task_new(self, cancellable, callback, user_data);
-		g_task_return_int(task, g_bytes_get_size(bytes));
-		g_object_unref(task);
+		g_usb_device_emulate_transfer_async(self,
+						    event_id,
+						    data,
+						    length,
+						    g_usb_device_interrupt_transfer_async,
+						    cancellable,
+						    callback,
+						    user_data);
 		return;
 	}
 
@@ -3246,7 +3930,7 @@ g_usb_device_get_configuration_index(GUsbDevice *self)
 	/* save */
 	if (g_usb_context_get_flags(priv->context) & G_USB_CONTEXT_FLAGS_SAVE_EVENTS) {
 		event = g_usb_device_save_event(self, event_id);
-		_g_usb_device_event_set_bytes_raw(event, &index, sizeof(index));
+		g_usb_device_set_event_data(self, event, &index, sizeof(index));
 	}
 
 	libusb_free_config_descriptor(config);
@@ -156,6 +156,8 @@ gboolean
 g_usb_device_is_emulated(GUsbDevice *self);
 GDateTime *
 g_usb_device_get_created(GUsbDevice *self);
+guint
+g_usb_device_get_generation(GUsbDevice *self);
 GUsbDevice *
 g_usb_device_get_parent(GUsbDevice *self);
 GPtrArray *
@@ -8,8 +8,36 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include "gusb-json-common.h"
 
+/* compact, so the result can be spliced into a larger document */
+gchar *
+_g_usb_json_builder_to_data(JsonBuilder *json_builder, gsize *length)
+{
+	g_autoptr(JsonGenerator) json_generator = json_generator_new();
+	g_autoptr(JsonNode) json_root = json_builder_get_root(json_builder);
+	json_generator_set_root(json_generator, json_root);
+	return json_generator_to_data(json_generator, length);
+}
+
+/* if @bufsz is negative then @buf is NUL terminated */
+gboolean
+_g_usb_json_write(GOutputStream *stream,
+		  const gchar *buf,
+		  gssize bufsz,
+		  GCancellable *cancellable,
+		  GError **error)
+{
+	return g_output_stream_write_all(stream,
+					 buf,
+					 bufsz < 0 ? strlen(buf) : (gsize)bufsz,
+					 NULL,
+					 cancellable,
+					 error);
+}
+
 #if !JSON_CHECK_VERSION(1, 6, 0)
 const char *
 json_object_get_string_member_with_default(JsonObject *json_object,
@@ -8,11 +8,20 @@
 
 #pragma once
 
-#include <glib.h>
+#include <gio/gio.h>
 #include <json-glib/json-glib.h>
 
 G_BEGIN_DECLS
 
+gchar *
+_g_usb_json_builder_to_data(JsonBuilder *json_builder, gsize *length);
+gboolean
+_g_usb_json_write(GOutputStream *stream,
+		  const gchar *buf,
+		  gssize bufsz,
+		  GCancellable *cancellable,
+		  GError **error);
+
 #if !JSON_CHECK_VERSION(1, 6, 0)
 const char *
 json_object_get_string_member_with_default(JsonObject *json_object,
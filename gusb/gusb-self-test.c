@@ -7,7 +7,10 @@
 
 #include "config.h"
 
+#include <glib/gstdio.h>
+
 #include "gusb-context-private.h"
+#include "gusb-device-private.h"
 
 static void
 gusb_device_func(void)
@@ -621,6 +624,1534 @@ gusb_device_json_func(void)
 	g_assert_true(g_usb_device_has_tag(device3, "emulation"));
 }
 
+typedef struct {
+	GMainLoop *loop;
+	gssize actual_length;
+} GUsbSelfTestHelper;
+
+static void
+_device_bulk_transfer_cb(GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+	GUsbSelfTestHelper *helper = (GUsbSelfTestHelper *)user_data;
+	g_autoptr(GError) error = NULL;
+
+	helper->actual_length =
+	    g_usb_device_bulk_transfer_finish(G_USB_DEVICE(source_object), res, &error);
+	g_assert_no_error(error);
+	g_main_loop_quit(helper->loop);
+}
+
+static void
+gusb_device_json_async_func(void)
+{
+	gboolean ret;
+	guint8 buf[3] = {0x0};
+	g_autoptr(GUsbContext) ctx = NULL;
+	g_autoptr(GUsbDevice) device = NULL;
+	g_autoptr(GError) error = NULL;
+	GUsbSelfTestHelper helper = {.actual_length = -1};
+	const gchar *json = "{"
+			    "  \"UsbDevices\" : ["
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:07\","
+			    "      \"Tags\" : ["
+			    "        \"emulation\""
+			    "      ],"
+			    "      \"IdVendor\" : 10047,"
+			    "      \"IdProduct\" : 4100,"
+			    "      \"UsbEvents\" : ["
+			    "        {"
+			    "          \"Id\" : "
+			    "\"BulkTransfer:Endpoint=0x81,Data=AAAA,Length=0x3\","
+			    "          \"Data\" : \"AQID\""
+			    "        }"
+			    "      ]"
+			    "    }"
+			    "  ]"
+			    "}";
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	ret = _g_usb_context_load_json(ctx, json, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	device = g_usb_context_find_by_platform_id(ctx, "usb:AA:AA:07", &error);
+	g_assert_no_error(error);
+	g_assert(device != NULL);
+
+	/* not completed until the main loop runs */
+	helper.loop = g_main_loop_new(NULL, FALSE);
+	g_usb_device_bulk_transfer_async(device,
+					 0x81,
+					 buf,
+					 sizeof(buf),
+					 1000,
+					 NULL,
+					 _device_bulk_transfer_cb,
+					 &helper);
+	g_assert_cmpint(helper.actual_length, ==, -1);
+	g_assert_cmpint(buf[0], ==, 0x0);
+	g_main_loop_run(helper.loop);
+	g_main_loop_unref(helper.loop);
+	g_assert_cmpint(helper.actual_length, ==, 3);
+	g_assert_cmpint(buf[0], ==, 0x01);
+	g_assert_cmpint(buf[2], ==, 0x03);
+}
+
+static void
+gusb_context_archive_func(void)
+{
+	gboolean ret;
+	GBytes *bytes;
+	GUsbDeviceEvent *event;
+	g_autofree gchar *filename = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+	g_autoptr(GUsbContext) ctx2 = NULL;
+	g_autoptr(GUsbDevice) device = NULL;
+	g_autoptr(GPtrArray) events = NULL;
+	g_autoptr(GError) error = NULL;
+	const gchar *json = "{"
+			    "  \"UsbDevices\" : ["
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:08\","
+			    "      \"Tags\" : ["
+			    "        \"emulation\""
+			    "      ],"
+			    "      \"IdVendor\" : 10047,"
+			    "      \"IdProduct\" : 4100,"
+			    "      \"UsbEvents\" : ["
+			    "        {"
+			    "          \"Id\" : \"GetStringDescriptor:DescIndex=0x03\","
+			    "          \"Data\" : \"AQID\""
+			    "        }"
+			    "      ]"
+			    "    }"
+			    "  ]"
+			    "}";
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	ret = _g_usb_context_load_json(ctx, json, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+
+	/* save as a binary archive */
+	filename = g_build_filename(g_get_tmp_dir(), "gusb-self-test.gusb", NULL);
+	ret = g_usb_context_save_archive(ctx, filename, "emulation", &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+
+	/* load into a new context */
+	ctx2 = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx2 != NULL);
+	ret = g_usb_context_load_archive(ctx2, filename, "emulation", &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	device = g_usb_context_find_by_platform_id(ctx2, "usb:AA:AA:08", &error);
+	g_assert_no_error(error);
+	g_assert(device != NULL);
+	g_assert_cmpint(g_usb_device_get_vid(device), ==, 0x273f);
+	events = g_usb_device_get_events(device);
+	g_assert_cmpint(events->len, ==, 1);
+	event = g_ptr_array_index(events, 0);
+	g_assert_cmpstr(g_usb_device_event_get_id(event), ==, "GetStringDescriptor:DescIndex=0x03");
+	bytes = g_usb_device_event_get_bytes(event);
+	g_assert_nonnull(bytes);
+	g_assert_cmpint(g_bytes_get_size(bytes), ==, 3);
+	g_assert_cmpint(((const guint8 *)g_bytes_get_data(bytes, NULL))[2], ==, 0x03);
+	g_unlink(filename);
+}
+
+static void
+gusb_context_lazy_func(void)
+{
+	gboolean ret;
+	g_autoptr(GUsbContext) ctx = NULL;
+	g_autoptr(GUsbDevice) device = NULL;
+	g_autoptr(GPtrArray) events = NULL;
+	g_autoptr(GPtrArray) interfaces = NULL;
+	g_autoptr(GError) error = NULL;
+	const gchar *json = "{"
+			    "  \"UsbDevices\" : ["
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:09\","
+			    "      \"Tags\" : ["
+			    "        \"emulation\""
+			    "      ],"
+			    "      \"IdVendor\" : 10047,"
+			    "      \"IdProduct\" : 4100,"
+			    "      \"UsbInterfaces\" : ["
+			    "        {"
+			    "          \"InterfaceClass\" : 255"
+			    "        }"
+			    "      ],"
+			    "      \"UsbEvents\" : ["
+			    "        {"
+			    "          \"Id\" : \"GetStringDescriptor:DescIndex=0x03\","
+			    "          \"Data\" : \"AQID\""
+			    "        }"
+			    "      ]"
+			    "    }"
+			    "  ]"
+			    "}";
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	g_usb_context_set_flags(ctx, G_USB_CONTEXT_FLAGS_LAZY_LOAD);
+	ret = _g_usb_context_load_json(ctx, json, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+
+	/* indexed up front */
+	device = g_usb_context_find_by_vid_pid(ctx, 0x273f, 0x1004, &error);
+	g_assert_no_error(error);
+	g_assert(device != NULL);
+	g_assert_cmpstr(g_usb_device_get_platform_id(device), ==, "usb:AA:AA:09");
+	g_assert_true(g_usb_device_has_tag(device, "emulation"));
+
+	/* loaded on demand */
+	interfaces = g_usb_device_get_interfaces(device, &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(interfaces);
+	g_assert_cmpint(interfaces->len, ==, 1);
+	events = g_usb_device_get_events(device);
+	g_assert_cmpint(events->len, ==, 1);
+}
+
+static void
+gusb_context_lazy_invalid_func(void)
+{
+	gboolean ret;
+	g_autoptr(GUsbContext) ctx = NULL;
+	g_autoptr(GUsbDevice) device = NULL;
+	g_autoptr(GPtrArray) interfaces = NULL;
+	g_autoptr(GError) error = NULL;
+	const gchar *json = "{"
+			    "  \"UsbDevices\" : ["
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:17\","
+			    "      \"Tags\" : ["
+			    "        \"emulation\""
+			    "      ],"
+			    "      \"IdVendor\" : 10047,"
+			    "      \"IdProduct\" : 4100,"
+			    "      \"UsbInterfaces\" : ["
+			    "        {"
+			    "          \"InterfaceClass\" : 255"
+			    "        }"
+			    "      ],"
+			    "      \"UsbEvents\" : ["
+			    "        {"
+			    "          \"Id\" : \"GetStringDescriptor:DescIndex=0x03\","
+			    "          \"Repeat\" : 0"
+			    "        }"
+			    "      ]"
+			    "    }"
+			    "  ]"
+			    "}";
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+
+	/* the invalid event is only found when loading everything up front */
+	ret = _g_usb_context_load_json(ctx, json, &error);
+	g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+	g_assert_false(ret);
+	g_clear_error(&error);
+
+	/* so loading lazily succeeds */
+	g_usb_context_set_flags(ctx, G_USB_CONTEXT_FLAGS_LAZY_LOAD);
+	ret = _g_usb_context_load_json(ctx, json, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	device = g_usb_context_find_by_platform_id(ctx, "usb:AA:AA:17", &error);
+	g_assert_no_error(error);
+	g_assert(device != NULL);
+
+	/* and the error is returned on every use, not just the first */
+	for (guint i = 0; i < 2; i++) {
+		interfaces = g_usb_device_get_interfaces(device, &error);
+		g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+		g_assert_null(interfaces);
+		g_clear_error(&error);
+	}
+}
+
+static void
+gusb_context_blobs_func(void)
+{
+	gboolean ret;
+	const gchar *tmp;
+	GUsbDeviceEvent *event1;
+	GUsbDeviceEvent *event2;
+	g_autofree gchar *data = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) events1 = NULL;
+	g_autoptr(GPtrArray) events2 = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+	g_autoptr(GUsbContext) ctx2 = NULL;
+	g_autoptr(GUsbDevice) device1 = NULL;
+	g_autoptr(GUsbDevice) device2 = NULL;
+	g_autoptr(JsonBuilder) json_builder = json_builder_new();
+	g_autoptr(JsonGenerator) json_generator = json_generator_new();
+	g_autoptr(JsonNode) json_root = NULL;
+	const gchar *json = "{"
+			    "  \"UsbDevices\" : ["
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:0A\","
+			    "      \"Tags\" : [\"emulation\"],"
+			    "      \"UsbEvents\" : ["
+			    "        {\"Id\" : \"Req1\", \"Data\" : \"AQID\"},"
+			    "        {\"Id\" : \"Req1\", \"Data\" : \"AQID\"}"
+			    "      ]"
+			    "    },"
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:0B\","
+			    "      \"Tags\" : [\"emulation\"],"
+			    "      \"UsbEvents\" : ["
+			    "        {\"Id\" : \"Req2\", \"Data\" : \"AQID\"}"
+			    "      ]"
+			    "    }"
+			    "  ]"
+			    "}";
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	ret = _g_usb_context_load_json(ctx, json, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+
+	/* the same payload is shared between events and devices */
+	device1 = g_usb_context_find_by_platform_id(ctx, "usb:AA:AA:0A", &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(device1);
+	device2 = g_usb_context_find_by_platform_id(ctx, "usb:AA:AA:0B", &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(device2);
+	events1 = g_usb_device_get_events(device1);
+	g_assert_cmpint(events1->len, ==, 2);
+	events2 = g_usb_device_get_events(device2);
+	g_assert_cmpint(events2->len, ==, 1);
+	event1 = g_ptr_array_index(events1, 0);
+	event2 = g_ptr_array_index(events2, 0);
+	g_assert_true(g_bytes_get_data(g_usb_device_event_get_bytes(event1), NULL) ==
+		      g_bytes_get_data(g_usb_device_event_get_bytes(event2), NULL));
+	g_assert_cmpint(_g_usb_context_get_blob_count(ctx), ==, 1);
+
+	/* and only written once */
+	g_usb_context_set_flags(ctx, G_USB_CONTEXT_FLAGS_SAVE_BLOB_TABLE);
+	ret = g_usb_context_save_with_tag(ctx, json_builder, "emulation", &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	json_root = json_builder_get_root(json_builder);
+	json_generator_set_root(json_generator, json_root);
+	data = json_generator_to_data(json_generator, NULL);
+	g_assert_nonnull(g_strstr_len(data, -1, "UsbBlobs"));
+	tmp = g_strstr_len(data, -1, "AQID");
+	g_assert_nonnull(tmp);
+	g_assert_null(g_strstr_len(tmp + 1, -1, "AQID"));
+
+	/* round trip */
+	ctx2 = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx2 != NULL);
+	ret = _g_usb_context_load_json(ctx2, data, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	g_clear_object(&device1);
+	g_clear_pointer(&events1, g_ptr_array_unref);
+	device1 = g_usb_context_find_by_platform_id(ctx2, "usb:AA:AA:0A", &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(device1);
+	events1 = g_usb_device_get_events(device1);
+	g_assert_cmpint(events1->len, ==, 2);
+	event1 = g_ptr_array_index(events1, 1);
+	g_assert_cmpint(g_bytes_get_size(g_usb_device_event_get_bytes(event1)), ==, 3);
+
+	/* the payload is dropped with the last event using it */
+	g_clear_pointer(&events2, g_ptr_array_unref);
+	g_usb_device_clear_events(device2);
+	g_assert_cmpint(_g_usb_context_get_blob_count(ctx), ==, 1);
+	g_clear_object(&device1);
+	device1 = g_usb_context_find_by_platform_id(ctx, "usb:AA:AA:0A", &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(device1);
+	g_usb_device_clear_events(device1);
+	g_assert_cmpint(_g_usb_context_get_blob_count(ctx), ==, 0);
+}
+
+static void
+gusb_device_repeat_func(void)
+{
+	gboolean ret;
+	GUsbDeviceEvent *event;
+	g_autofree gchar *str = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) events = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+	g_autoptr(GUsbDevice) device = NULL;
+	g_autoptr(JsonBuilder) json_builder = json_builder_new();
+	const gchar *json = "{"
+			    "  \"UsbDevices\" : ["
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:0C\","
+			    "      \"Tags\" : [\"emulation\"],"
+			    "      \"UsbEvents\" : ["
+			    "        {"
+			    "          \"Id\" : \"GetStringDescriptor:DescIndex=0x01\","
+			    "          \"Data\" : \"Zm9v\","
+			    "          \"Repeat\" : 2"
+			    "        },"
+			    "        {"
+			    "          \"Id\" : \"GetStringDescriptor:DescIndex=0x01\","
+			    "          \"Data\" : \"YmFy\""
+			    "        },"
+			    "        {"
+			    "          \"Id\" : \"GetStringDescriptor:DescIndex=0x03\","
+			    "          \"Data\" : \"cXV4\""
+			    "        },"
+			    "        {"
+			    "          \"Id\" : \"GetStringDescriptor:DescIndex=0x03\","
+			    "          \"Data\" : \"cXV4\""
+			    "        },"
+			    "        {"
+			    "          \"Id\" : \"GetStringDescriptor:DescIndex=0x02\",
+			    "          \"Data\" : \"YmF6\""
+			    "        },"
+			    "        {"
+			    "          \"Id\" : \"GetStringDescriptor:DescIndex=0x02\","
+			    "          \"Data\" : \"YmF6\""
+			    "        }"
+			    "      ]"
+			    "    }"
+			    "  ]"
+			    "}";
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	g_usb_context_set_flags(ctx, G_USB_CONTEXT_FLAGS_COMPRESS_EVENTS);
+	ret = _g_usb_context_load_json(ctx, json, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	device = g_usb_context_find_by_platform_id(ctx, "usb:AA:AA:0C", &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(device);
+
+	/* each repetition is used in turn */
+	for (guint i = 0; i < 2; i++) {
+		g_autofree gchar *str_tmp =
+		    g_usb_device_get_string_descriptor(device, 0x01, &error);
+		g_assert_no_error(error);
+		g_assert_cmpstr(str_tmp, ==, "foo");
+	}
+	str = g_usb_device_get_string_descriptor(device, 0x01, &error);
+	g_assert_no_error(error);
+	g_assert_cmpstr(str, ==, "bar");
+
+	/* identical events are merged, and not just at the end */
+	ret = g_usb_context_save(ctx, json_builder, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	events = g_usb_device_get_events(device);
+	g_assert_cmpint(events->len, ==, 4);
+	event = g_ptr_array_index(events, 0);
+	g_assert_cmpint(g_usb_device_event_get_repeat(event), ==, 2);
+	event = g_ptr_array_index(events, 2);
+	g_assert_cmpint(g_usb_device_event_get_repeat(event), ==, 2);
+	event = g_ptr_array_index(events, 3);
+	g_assert_cmpint(g_usb_device_event_get_repeat(event), ==, 2);
+}
+
+static void
+gusb_context_stream_func(void)
+{
+	gboolean ret;
+	GUsbDeviceEvent *event;
+	g_autoptr(GPtrArray) events = NULL;
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GConverter) compressor = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GInputStream) istream = NULL;
+	g_autoptr(GOutputStream) ostream = NULL;
+	g_autoptr(GOutputStream) ostream_mem = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+	g_autoptr(GUsbContext) ctx2 = NULL;
+	g_autoptr(GUsbDevice) device = NULL;
+	g_autoptr(GUsbDevice) device2 = NULL;
+	const gchar *json = "{"
+			    "  \"UsbDevices\" : ["
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:0D\","
+			    "      \"Tags\" : [\"emulation\"],"
+			    "      \"UsbEvents\" : ["
+			    "        {\"Id\" : \"Req1\", \"Data\" : \"AQID\"},"
+			    "        {\"Id\" : \"Req2\", \"Data\" : \"AQID\"}"
+			    "      ]"
+			    "    },"
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:0E\","
+			    "      \"Tags\" : [\"emulation\"]"
+			    "    }"
+			    "  ]"
+			    "}";
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	g_usb_context_set_flags(ctx, G_USB_CONTEXT_FLAGS_SAVE_BLOB_TABLE);
+	ret = _g_usb_context_load_json(ctx, json, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+
+	/* save compressed */
+	ostream_mem = g_memory_output_stream_new_resizable();
+	compressor = G_CONVERTER(g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+	ostream = g_converter_output_stream_new(ostream_mem, compressor);
+	ret = g_usb_context_save_stream(ctx, ostream, "emulation", NULL, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	ret = g_output_stream_close(ostream, NULL, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	blob = g_memory_output_stream_steal_as_bytes(G_MEMORY_OUTPUT_STREAM(ostream_mem));
+	g_assert_cmpint(((const guint8 *)g_bytes_get_data(blob, NULL))[0], ==, 0x1f);
+
+	/* load, detecting the compression */
+	ctx2 = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx2 != NULL);
+	istream = g_memory_input_stream_new_from_bytes(blob);
+	ret = g_usb_context_load_stream(ctx2, istream, "emulation", NULL, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	g_assert_false(g_input_stream_is_closed(istream));
+	device = g_usb_context_find_by_platform_id(ctx2, "usb:AA:AA:0D", &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(device);
+	events = g_usb_device_get_events(device);
+	g_assert_cmpint(events->len, ==, 2);
+	event = g_ptr_array_index(events, 1);
+	g_assert_cmpint(g_bytes_get_size(g_usb_device_event_get_bytes(event)), ==, 3);
+	device2 = g_usb_context_find_by_platform_id(ctx2, "usb:AA:AA:0E", &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(device2);
+}
+
+static void
+gusb_context_delta_func(void)
+{
+	gboolean ret;
+	guint generation;
+	JsonArray *json_array;
+	JsonObject *json_obj;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) devices = NULL;
+	g_autoptr(GPtrArray) events = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+	g_autoptr(GUsbContext) ctx2 = NULL;
+	g_autoptr(GUsbDevice) device = NULL;
+	g_autoptr(GUsbDevice) device2 = NULL;
+	g_autoptr(JsonBuilder) json_builder = json_builder_new();
+	g_autoptr(JsonBuilder) json_builder2 = json_builder_new();
+	g_autoptr(JsonBuilder) json_builder3 = json_builder_new();
+	g_autoptr(JsonNode) json_root = NULL;
+	g_autoptr(JsonNode) json_root2 = NULL;
+	g_autoptr(JsonNode) json_root3 = NULL;
+	const gchar *json = "{"
+			    "  \"UsbDevices\" : ["
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:0F\","
+			    "      \"Created\" : \"2023-02-01T16:35:03.302027Z\","
+			    "      \"Tags\" : [\"emulation\"],"
+			    "      \"UsbEvents\" : ["
+			    "        {\"Id\" : \"Req1\", \"Data\" : \"AQID\"}"
+			    "      ]"
+			    "    },"
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:10\","
+			    "      \"Created\" : \"2023-02-01T16:35:03.302027Z\","
+			    "      \"Tags\" : [\"emulation\"]"
+			    "    }"
+			    "  ]"
+			    "}";
+	const gchar *json_delta = "{"
+				  "  \"BaseGeneration\" : 0,"
+				  "  \"UsbDevices\" : [],"
+				  "  \"RemovedPlatformIds\" : [\"usb:AA:AA:10\"]"
+				  "}";
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	ret = _g_usb_context_load_json(ctx, json, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	ctx2 = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx2 != NULL);
+	ret = _g_usb_context_load_json(ctx2, json, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+
+	/* only the changed device is saved */
+	generation = g_usb_context_get_generation(ctx);
+	device = g_usb_context_find_by_platform_id(ctx, "usb:AA:AA:0F", &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(device);
+	g_usb_device_clear_events(device);
+	g_usb_device_add_tag(device, "changed");
+	g_assert_cmpint(g_usb_device_get_generation(device), >, generation);
+	ret = g_usb_context_save_delta(ctx, json_builder, "emulation", generation, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	json_root = json_builder_get_root(json_builder);
+	json_obj = json_node_get_object(json_root);
+	json_array = json_object_get_array_member(json_obj, "UsbDevices");
+	g_assert_cmpint(json_array_get_length(json_array), ==, 1);
+
+	/* apply on top of the base */
+	ret = g_usb_context_load_with_tag(ctx2, json_obj, "emulation", &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	devices = g_usb_context_get_devices(ctx2);
+	g_assert_cmpint(devices->len, ==, 2);
+	device2 = g_usb_context_find_by_platform_id(ctx2, "usb:AA:AA:0F", &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(device2);
+	events = g_usb_device_get_events(device2);
+	g_assert_cmpint(events->len, ==, 0);
+	g_assert_true(g_usb_device_has_tag(device2, "changed"));
+
+	/* removals are recorded */
+	ret = _g_usb_context_load_json(ctx, json_delta, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	g_clear_pointer(&devices, g_ptr_array_unref);
+	devices = g_usb_context_get_devices(ctx);
+	g_assert_cmpint(devices->len, ==, 1);
+	ret = g_usb_context_save_delta(ctx, json_builder2, NULL, generation, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	json_root2 = json_builder_get_root(json_builder2);
+	json_obj = json_node_get_object(json_root2);
+	json_array = json_object_get_array_member(json_obj, "RemovedPlatformIds");
+	g_assert_cmpint(json_array_get_length(json_array), ==, 1);
+	g_assert_cmpstr(json_array_get_string_element(json_array, 0), ==, "usb:AA:AA:10");
+
+	/* losing the tag is recorded like a removal for that tag */
+	generation = g_usb_context_get_generation(ctx);
+	g_usb_device_remove_tag(device, "emulation");
+	ret = g_usb_context_save_delta(ctx, json_builder3, "emulation", generation, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	json_root3 = json_builder_get_root(json_builder3);
+	json_obj = json_node_get_object(json_root3);
+	json_array = json_object_get_array_member(json_obj, "UsbDevices");
+	g_assert_cmpint(json_array_get_length(json_array), ==, 0);
+	json_array = json_object_get_array_member(json_obj, "RemovedPlatformIds");
+	g_assert_cmpint(json_array_get_length(json_array), ==, 1);
+	g_assert_cmpstr(json_array_get_string_element(json_array, 0), ==, "usb:AA:AA:0F");
+	ret = g_usb_context_load_with_tag(ctx2, json_obj, "emulation", &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	g_clear_pointer(&devices, g_ptr_array_unref);
+	devices = g_usb_context_get_devices(ctx2);
+	g_assert_cmpint(devices->len, ==, 1);
+}
+
+static void
+gusb_context_index_func(void)
+{
+	gboolean ret;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+	g_autoptr(GUsbDevice) device = NULL;
+	g_autoptr(GUsbDevice) device2 = NULL;
+	g_autoptr(GUsbDevice) device3 = NULL;
+	const gchar *json = "{"
+			    "  \"UsbDevices\" : ["
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:11\","
+			    "      \"IdVendor\" : 10047,"
+			    "      \"IdProduct\" : 4100,"
+			    "      \"Tags\" : [\"emulation\"]"
+			    "    },"
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:12\","
+			    "      \"IdVendor\" : 10047,"
+			    "      \"IdProduct\" : 4100,"
+			    "      \"Tags\" : [\"emulation\"]"
+			    "    }"
+			    "  ]"
+			    "}";
+	const gchar *json2 = "{"
+			     "  \"UsbDevices\" : ["
+			     "    {"
+			     "      \"PlatformId\" : \"usb:AA:AA:12\","
+			     "      \"IdVendor\" : 10047,"
+			     "      \"IdProduct\" : 4100,"
+			     "      \"Tags\" : [\"emulation\"]"
+			     "    }"
+			     "  ]"
+			     "}";
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	ret = _g_usb_context_load_json(ctx, json, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+
+	/* the first device with the key wins */
+	device = g_usb_context_find_by_vid_pid(ctx, 0x273f, 0x1004, &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(device);
+	g_assert_cmpstr(g_usb_device_get_platform_id(device), ==, "usb:AA:AA:11");
+
+	/* the index follows the removal */
+	ret = _g_usb_context_load_json(ctx, json2, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	device2 = g_usb_context_find_by_vid_pid(ctx, 0x273f, 0x1004, &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(device2);
+	g_assert_cmpstr(g_usb_device_get_platform_id(device2), ==, "usb:AA:AA:12");
+	device3 = g_usb_context_find_by_platform_id(ctx, "usb:AA:AA:11", &error);
+	g_assert_error(error, G_USB_DEVICE_ERROR, G_USB_DEVICE_ERROR_NO_DEVICE);
+	g_assert_null(device3);
+}
+
+static void
+gusb_context_match_rules_func(void)
+{
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) devices = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+
+	/* no rules matches everything */
+	g_assert_true(_g_usb_context_match_rules_check(ctx, 0x273f, 0x1004, 0x00));
+
+	/* any rule can match, and -1 is a wildcard */
+	g_usb_context_add_match_rule(ctx, 0x273f, -1, -1);
+	g_usb_context_add_match_rule(ctx, -1, -1, 0x09);
+	g_assert_true(_g_usb_context_match_rules_check(ctx, 0x273f, 0x1004, 0x00));
+	g_assert_true(_g_usb_context_match_rules_check(ctx, 0x1d6b, 0x0002, 0x09));
+	g_assert_false(_g_usb_context_match_rules_check(ctx, 0x1d6b, 0x0002, 0x00));
+
+	/* devices that do not match are never added */
+	devices = g_usb_context_get_devices(ctx);
+	for (guint i = 0; i < devices->len; i++) {
+		GUsbDevice *device = g_ptr_array_index(devices, i);
+		guint16 vid = g_usb_device_get_vid(device);
+		guint16 pid = g_usb_device_get_pid(device);
+		guint8 device_class = g_usb_device_get_device_class(device);
+		g_assert_true(_g_usb_context_match_rules_check(ctx, vid, pid, device_class));
+	}
+}
+
+static void
+_context_enumerate_cb(GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+	GMainLoop *loop = (GMainLoop *)user_data;
+	g_autoptr(GError) error = NULL;
+	gboolean ret;
+
+	ret = g_usb_context_enumerate_finish(G_USB_CONTEXT(source_object), res, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	g_main_loop_quit(loop);
+}
+
+static void
+_context_device_added_cb(GUsbContext *ctx, GUsbDevice *device, gpointer user_data)
+{
+	guint *cnt = (guint *)user_data;
+	(*cnt)++;
+}
+
+static void
+gusb_context_enumerate_async_func(void)
+{
+	guint cnt = 0;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
+	g_autoptr(GPtrArray) devices = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	g_signal_connect(ctx, "device-added", G_CALLBACK(_context_device_added_cb), &cnt);
+
+	/* every device is signalled before the task completes */
+	g_usb_context_enumerate_async(ctx, NULL, _context_enumerate_cb, loop);
+	g_main_loop_run(loop);
+	devices = g_usb_context_get_devices(ctx);
+	g_assert_cmpint(devices->len, ==, cnt);
+}
+
+typedef struct {
+	GMainLoop *loop;
+	GCancellable *cancellable;
+	guint added_cnt;
+	guint added_cnt_done;
+	guint pending;
+	guint devices_len[2];
+} GUsbEnumerateHelper;
+
+static void
+_context_enumerate_helper_cb(GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+	GUsbEnumerateHelper *helper = (GUsbEnumerateHelper *)user_data;
+	GUsbContext *ctx = G_USB_CONTEXT(source_object);
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) devices = NULL;
+
+	/* cancelled only if there was a device to cancel from */
+	if (!g_usb_context_enumerate_finish(ctx, res, &error))
+		g_assert_error(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+	helper->added_cnt_done = helper->added_cnt;
+	devices = g_usb_context_get_devices(ctx);
+	helper->devices_len[--helper->pending] = devices->len;
+	if (helper->pending == 0)
+		g_main_loop_quit(helper->loop);
+}
+
+static void
+_context_enumerate_helper_added_cb(GUsbContext *ctx, GUsbDevice *device, gpointer user_data)
+{
+	GUsbEnumerateHelper *helper = (GUsbEnumerateHelper *)user_data;
+	helper->added_cnt++;
+	if (helper->cancellable != NULL)
+		g_cancellable_cancel(helper->cancellable);
+}
+
+static void
+gusb_context_enumerate_async_twice_func(void)
+{
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
+	g_autoptr(GPtrArray) devices = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+	GUsbEnumerateHelper helper = {.loop = loop, .pending = 2};
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	g_signal_connect(ctx,
+			 "device-added",
+			 G_CALLBACK(_context_enumerate_helper_added_cb),
+			 &helper);
+
+	/* the second call waits for the first to finish */
+	g_usb_context_enumerate_async(ctx, NULL, _context_enumerate_helper_cb, &helper);
+	g_usb_context_enumerate_async(ctx, NULL, _context_enumerate_helper_cb, &helper);
+	g_main_loop_run(loop);
+	devices = g_usb_context_get_devices(ctx);
+	g_assert_cmpint(helper.devices_len[0], ==, devices->len);
+	g_assert_cmpint(helper.devices_len[1], ==, devices->len);
+	g_assert_cmpint(helper.added_cnt, ==, devices->len);
+}
+
+static void
+gusb_context_enumerate_async_cancel_func(void)
+{
+	g_autoptr(GCancellable) cancellable = g_cancellable_new();
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
+	g_autoptr(GPtrArray) devices = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+	GUsbEnumerateHelper helper = {.loop = loop, .cancellable = cancellable, .pending = 1};
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	g_signal_connect(ctx,
+			 "device-added",
+			 G_CALLBACK(_context_enumerate_helper_added_cb),
+			 &helper);
+
+	/* cancelled from the first device-added signal */
+	g_usb_context_enumerate_async(ctx, cancellable, _context_enumerate_helper_cb, &helper);
+	g_main_loop_run(loop);
+
+	/* nothing already queued is added once cancelled */
+	g_assert_cmpint(helper.added_cnt_done, <=, 1);
+
+	/* the rest are added by the next enumerate, and nothing is signalled twice */
+	devices = g_usb_context_get_devices(ctx);
+	g_assert_cmpint(helper.added_cnt, ==, devices->len);
+}
+
+static void
+gusb_context_hotplug_collapse_func(void)
+{
+	const guint keys[] = {0x101, 0x101, 0x102, 0x103, 0x103, 0x103};
+	const libusb_hotplug_event events[] = {
+	    LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED,
+	    LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+	    LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+	    LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED,
+	    LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED,
+	    LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+	};
+	gboolean dropped[G_N_ELEMENTS(keys)] = {FALSE};
+	guint collapsed;
+
+	/* a LEFT pairs with the last unpaired ARRIVED for the same bus and address */
+	collapsed = _g_usb_context_hotplug_collapse(keys, events, G_N_ELEMENTS(keys), dropped);
+	g_assert_cmpint(collapsed, ==, 2);
+	g_assert_true(dropped[0]);
+	g_assert_true(dropped[1]);
+	g_assert_false(dropped[2]);
+	g_assert_false(dropped[3]);
+	g_assert_true(dropped[4]);
+	g_assert_true(dropped[5]);
+}
+
+static void
+gusb_context_hotplug_debounce_timeout_func(void)
+{
+	/* a storm is flushed once the first event has been held for four windows */
+	g_assert_cmpint(_g_usb_context_hotplug_debounce_timeout(100, 0), ==, 100);
+	g_assert_cmpint(_g_usb_context_hotplug_debounce_timeout(100, 350), ==, 50);
+	g_assert_cmpint(_g_usb_context_hotplug_debounce_timeout(100, 400), ==, 0);
+	g_assert_cmpint(_g_usb_context_hotplug_debounce_timeout(100, 1000), ==, 0);
+}
+
+static void
+gusb_context_source_func(void)
+{
+	GUsbSource *source;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) devices = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+
+#ifdef _WIN32
+	g_test_skip("libusb does not expose pollfds on Windows");
+	return;
+#endif
+
+	/* the same source is returned each time */
+	source = g_usb_context_get_source(ctx, NULL);
+	g_assert_nonnull(source);
+	g_assert_true(g_usb_context_get_source(ctx, NULL) == source);
+
+	/* events are now handled in this thread */
+	devices = g_usb_context_get_devices(ctx);
+	g_assert_nonnull(devices);
+	while (g_main_context_iteration(NULL, FALSE))
+		;
+}
+
+static void
+gusb_context_source_main_ctx_func(void)
+{
+	GUsbSource *source;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GMainContext) main_ctx = g_main_context_new();
+	g_autoptr(GPtrArray) devices = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+
+#ifdef _WIN32
+	g_test_skip("libusb does not expose pollfds on Windows");
+	return;
+#endif
+
+	/* the hotplug and rescan sources follow the transfers into the new context */
+	source = g_usb_context_get_source(ctx, main_ctx);
+	g_assert_nonnull(source);
+	g_assert_true(g_usb_context_get_main_context(ctx) == main_ctx);
+	devices = g_usb_context_get_devices(ctx);
+	g_assert_nonnull(devices);
+	while (g_main_context_iteration(main_ctx, FALSE))
+		;
+}
+
+static void
+gusb_context_shards_func(void)
+{
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) devices = NULL;
+	g_autoptr(GPtrArray) devices_sharded = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+	g_autoptr(GUsbContext) ctx_sharded = NULL;
+	guint event_shards = 0;
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	ctx_sharded = g_initable_new(G_USB_TYPE_CONTEXT, NULL, &error, "event_shards", 3, NULL);
+	g_assert_no_error(error);
+	g_assert(ctx_sharded != NULL);
+	g_object_get(ctx_sharded, "event_shards", &event_shards, NULL);
+	g_assert_cmpint(event_shards, ==, 3);
+
+	/* each device is owned by exactly one shard */
+	devices = g_usb_context_get_devices(ctx);
+	devices_sharded = g_usb_context_get_devices(ctx_sharded);
+	g_assert_cmpint(devices_sharded->len, ==, devices->len);
+	for (guint i = 0; i < devices->len; i++) {
+		GUsbDevice *device = g_ptr_array_index(devices, i);
+		g_autoptr(GUsbDevice) device_sharded = NULL;
+
+		device_sharded =
+		    g_usb_context_find_by_bus_address(ctx_sharded,
+						      g_usb_device_get_bus(device),
+						      g_usb_device_get_address(device),
+						      &error);
+		g_assert_no_error(error);
+		g_assert_nonnull(device_sharded);
+	}
+}
+
+static gpointer
+gusb_context_snapshot_thread_cb(gpointer user_data)
+{
+	GUsbContext *ctx = G_USB_CONTEXT(user_data);
+	return g_usb_context_get_devices(ctx);
+}
+
+static void
+gusb_context_snapshot_func(void)
+{
+	gboolean ret;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) devices = NULL;
+	g_autoptr(GPtrArray) devices2 = NULL;
+	g_autoptr(GPtrArray) devices3 = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+	const gchar *json = "{"
+			    "  \"UsbDevices\" : ["
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:13\","
+			    "      \"Tags\" : [\"emulation\"]"
+			    "    },"
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:14\","
+			    "      \"Tags\" : [\"emulation\"]"
+			    "    }"
+			    "  ]"
+			    "}";
+	const gchar *json2 = "{"
+			     "  \"UsbDevices\" : ["
+			     "    {"
+			     "      \"PlatformId\" : \"usb:AA:AA:14\","
+			     "      \"Tags\" : [\"emulation\"]"
+			     "    }"
+			     "  ]"
+			     "}";
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	ret = _g_usb_context_load_json(ctx, json, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	devices = g_usb_context_get_devices(ctx);
+	g_assert_cmpint(devices->len, >=, 2);
+
+	/* the old snapshot is not changed by the removal */
+	ret = _g_usb_context_load_json(ctx, json2, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	devices2 = g_usb_context_get_devices(ctx);
+	g_assert_cmpint(devices2->len, ==, devices->len - 1);
+
+	/* and the same snapshot is seen from another thread */
+	devices3 = g_thread_join(g_thread_new("snapshot", gusb_context_snapshot_thread_cb, ctx));
+	g_assert_true(devices3 == devices2);
+}
+
+typedef struct {
+	guint cnt;
+	GUsbDevice *device;
+	GError *error;
+} GUsbReplugHelper;
+
+static gboolean
+_context_replug_match_vid_cb(GUsbDevice *device, GUsbDevice *device_new, gpointer user_data)
+{
+	return g_usb_device_get_vid(device) == g_usb_device_get_vid(device_new);
+}
+
+static void
+_context_replug_notify_cb(gpointer user_data)
+{
+	guint *cnt = (guint *)user_data;
+	(*cnt)++;
+}
+
+static void
+_context_device_removed_cb(GUsbContext *ctx, GUsbDevice *device, gpointer user_data)
+{
+	guint *cnt = (guint *)user_data;
+	(*cnt)++;
+}
+
+static void
+_context_replug_cb(GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+	GUsbReplugHelper *helper = (GUsbReplugHelper *)user_data;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GUsbDevice) device = NULL;
+
+	device = g_usb_context_wait_for_replug_finish(G_USB_CONTEXT(source_object), res, &error);
+	if (device != NULL)
+		helper->device = g_steal_pointer(&device);
+	else
+		g_propagate_error(&helper->error, g_steal_pointer(&error));
+	helper->cnt++;
+}
+
+static void
+gusb_context_replug_async_func(void)
+{
+	gboolean ret;
+	guint cnt_added = 0;
+	guint cnt_notify = 0;
+	guint cnt_removed = 0;
+	GUsbReplugHelper helper = {0};
+	GUsbReplugHelper helper2 = {0};
+	GUsbReplugHelper helper3 = {0};
+	GUsbReplugHelper helper4 = {0};
+	GUsbReplugHelper helper5 = {0};
+	GUsbReplugHelper helper6 = {0};
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+	g_autoptr(GUsbDevice) device = NULL;
+	g_autoptr(GUsbDevice) device2 = NULL;
+	g_autoptr(GUsbDevice) device3 = NULL;
+	const gchar *json = "{"
+			    "  \"UsbDevices\" : ["
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:15\","
+			    "      \"IdVendor\" : 10047,"
+			    "      \"IdProduct\" : 4100,"
+			    "      \"Tags\" : [\"emulation\"]"
+			    "    }"
+			    "  ]"
+			    "}";
+	const gchar *json2 = "{"
+			     "  \"UsbDevices\" : ["
+			     "    {"
+			     "      \"PlatformId\" : \"usb:AA:AA:16\","
+			     "      \"IdVendor\" : 10047,"
+			     "      \"IdProduct\" : 4101,"
+			     "      \"Tags\" : [\"emulation\"]"
+			     "    }"
+			     "  ]"
+			     "}";
+	const gchar *json3 = "{ \"UsbDevices\" : [] }";
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	g_usb_context_enumerate(ctx);
+	ret = _g_usb_context_load_json(ctx, json, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	device = g_usb_context_find_by_platform_id(ctx, "usb:AA:AA:15", &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(device);
+
+	/* comes back on a different port with a new PID, so the old device is gone */
+	g_signal_connect(ctx, "device-added", G_CALLBACK(_context_device_added_cb), &cnt_added);
+	g_signal_connect(ctx,
+			 "device-removed",
+			 G_CALLBACK(_context_device_removed_cb),
+			 &cnt_removed);
+	g_usb_context_wait_for_replug_async(ctx,
+					    device,
+					    _context_replug_match_vid_cb,
+					    &cnt_notify,
+					    _context_replug_notify_cb,
+					    0,
+					    NULL,
+					    _context_replug_cb,
+					    &helper);
+	g_usb_context_wait_for_replug_async(ctx,
+					    device,
+					    NULL,
+					    NULL,
+					    NULL,
+					    10,
+					    NULL,
+					    _context_replug_cb,
+					    &helper2);
+	ret = _g_usb_context_load_json(ctx, json2, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	while (helper.cnt == 0 || helper2.cnt == 0)
+		g_main_context_iteration(NULL, TRUE);
+	g_assert_no_error(helper.error);
+	g_assert_nonnull(helper.device);
+	g_assert_cmpstr(g_usb_device_get_platform_id(helper.device), ==, "usb:AA:AA:16");
+	g_assert_cmpint(cnt_added, ==, 1);
+	g_assert_cmpint(cnt_removed, ==, 1);
+	g_assert_cmpint(cnt_notify, ==, 1);
+	device2 = g_steal_pointer(&helper.device);
+
+	/* the same platform ID never came back, and the removal is not emitted again */
+	g_assert_error(helper2.error, G_USB_CONTEXT_ERROR, G_USB_CONTEXT_ERROR_INTERNAL);
+	g_assert_null(helper2.device);
+	g_clear_error(&helper2.error);
+	g_assert_cmpint(cnt_removed, ==, 1);
+
+	/* comes back on the same port, so neither signal is emitted */
+	g_usb_context_wait_for_replug_async(ctx,
+					    device2,
+					    NULL,
+					    NULL,
+					    NULL,
+					    0,
+					    NULL,
+					    _context_replug_cb,
+					    &helper3);
+	ret = _g_usb_context_load_json(ctx, json3, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	ret = _g_usb_context_load_json(ctx, json2, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	while (helper3.cnt == 0)
+		g_main_context_iteration(NULL, TRUE);
+	g_assert_no_error(helper3.error);
+	g_assert_nonnull(helper3.device);
+	g_assert_cmpstr(g_usb_device_get_platform_id(helper3.device), ==, "usb:AA:AA:16");
+	g_assert_cmpint(cnt_added, ==, 1);
+	g_assert_cmpint(cnt_removed, ==, 1);
+	device3 = g_steal_pointer(&helper3.device);
+
+	/* two waiters give up on the same device, and the removal is only emitted once */
+	g_usb_context_wait_for_replug_async(ctx,
+					    device3,
+					    NULL,
+					    NULL,
+					    NULL,
+					    10,
+					    NULL,
+					    _context_replug_cb,
+					    &helper4);
+	g_usb_context_wait_for_replug_async(ctx,
+					    device3,
+					    NULL,
+					    NULL,
+					    NULL,
+					    20,
+					    NULL,
+					    _context_replug_cb,
+					    &helper5);
+	ret = _g_usb_context_load_json(ctx, json3, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	while (helper4.cnt == 0 || helper5.cnt == 0)
+		g_main_context_iteration(NULL, TRUE);
+	g_assert_error(helper4.error, G_USB_CONTEXT_ERROR, G_USB_CONTEXT_ERROR_INTERNAL);
+	g_assert_error(helper5.error, G_USB_CONTEXT_ERROR, G_USB_CONTEXT_ERROR_INTERNAL);
+	g_clear_error(&helper4.error);
+	g_clear_error(&helper5.error);
+	g_assert_cmpint(cnt_removed, ==, 2);
+
+	/* the removal was already emitted, so a late waiter does not hide the add */
+	g_usb_context_wait_for_replug_async(ctx,
+					    device3,
+					    NULL,
+					    NULL,
+					    NULL,
+					    0,
+					    NULL,
+					    _context_replug_cb,
+					    &helper6);
+	ret = _g_usb_context_load_json(ctx, json2, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	while (helper6.cnt == 0)
+		g_main_context_iteration(NULL, TRUE);
+	g_assert_no_error(helper6.error);
+	g_assert_nonnull(helper6.device);
+	g_assert_cmpint(cnt_added, ==, 2);
+	g_assert_cmpint(cnt_removed, ==, 2);
+	g_clear_object(&helper6.device);
+}
+
+static void
+gusb_device_custom_index_func(void)
+{
+	gboolean ret;
+	guint8 idx;
+	GUsbDevice *device_real = NULL;
+	GUsbInterface *intf = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) devices = NULL;
+	g_autoptr(GPtrArray) interfaces = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+	g_autoptr(GUsbContext) ctx2 = NULL;
+	g_autoptr(GUsbDevice) device = NULL;
+	const gchar *json = "{"
+			    "  \"UsbDevices\" : ["
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:18\","
+			    "      \"Tags\" : [\"emulation\"],"
+			    "      \"UsbInterfaces\" : ["
+			    "        {"
+			    "          \"InterfaceClass\" : 255,"
+			    "          \"InterfaceSubClass\" : 70,"
+			    "          \"InterfaceProtocol\" : 87,"
+			    "          \"Interface\" : 3"
+			    "        },"
+			    "        {"
+			    "          \"InterfaceClass\" : 255,"
+			    "          \"InterfaceSubClass\" : 70,"
+			    "          \"InterfaceProtocol\" : 87,"
+			    "          \"Interface\" : 4"
+			    "        }"
+			    "      ]"
+			    "    }"
+			    "  ]"
+			    "}";
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	ret = _g_usb_context_load_json(ctx, json, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	device = g_usb_context_find_by_platform_id(ctx, "usb:AA:AA:18", &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(device);
+
+	/* the first interface wins */
+	idx = _g_usb_device_lookup_custom_index(device, 0xff, 0x46, 0x57, &error);
+	g_assert_no_error(error);
+	g_assert_cmpint(idx, ==, 3);
+
+	/* no match */
+	idx = _g_usb_device_lookup_custom_index(device, 0xff, 0x47, 0x55, &error);
+	g_assert_error(error, G_USB_DEVICE_ERROR, G_USB_DEVICE_ERROR_NOT_SUPPORTED);
+	g_assert_cmpint(idx, ==, 0x00);
+	g_clear_error(&error);
+
+	/* the table is dropped with the interfaces, which cannot be read back when emulated */
+	g_usb_device_invalidate(device);
+	idx = _g_usb_device_lookup_custom_index(device, 0xff, 0x46, 0x57, &error);
+	g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED);
+	g_assert_cmpint(idx, ==, 0x00);
+	g_clear_error(&error);
+
+	/* a physical device rebuilds the table from the active configuration, where the first
+	 * interface always wins */
+	ctx2 = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx2 != NULL);
+	devices = g_usb_context_get_devices(ctx2);
+	for (guint i = 0; i < devices->len && intf == NULL; i++) {
+		device_real = g_ptr_array_index(devices, i);
+		interfaces = g_usb_device_get_interfaces(device_real, NULL);
+		if (interfaces == NULL)
+			continue;
+		if (interfaces->len > 0) {
+			GUsbInterface *intf_tmp = g_ptr_array_index(interfaces, 0);
+			if (g_usb_interface_get_index(intf_tmp) != 0x00)
+				intf = intf_tmp;
+		}
+		if (intf == NULL)
+			g_clear_pointer(&interfaces, g_ptr_array_unref);
+	}
+	if (intf == NULL) {
+		g_test_skip("no physical interface with a string index");
+		return;
+	}
+	for (guint i = 0; i < 2; i++) {
+		idx = _g_usb_device_lookup_custom_index(device_real,
+							g_usb_interface_get_class(intf),
+							g_usb_interface_get_subclass(intf),
+							g_usb_interface_get_protocol(intf),
+							&error);
+		g_assert_no_error(error);
+		g_assert_cmpint(idx, ==, g_usb_interface_get_index(intf));
+		g_usb_device_invalidate(device_real);
+	}
+}
+
+static void
+gusb_device_string_descriptor_func(void)
+{
+	gboolean ret;
+	gint rc;
+	guint8 data[8] = {0x0};
+	const guint8 buf[] = {0x0a, 0x03, 'H', 0x00, 'i', 0x00, 0xe9, 0x00, 0x3a, 0x26};
+	const guint8 buf_short[] = {0x0a, 0x03, 'H', 0x00};
+	const guint8 buf_type[] = {0x04, 0x02, 'H', 0x00};
+	g_autoptr(GBytes) bytes = g_bytes_new_static(buf, sizeof(buf));
+	g_autoptr(GBytes) bytes2 = NULL;
+	g_autoptr(GBytes) bytes3 = NULL;
+	g_autoptr(GBytes) bytes4 = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+	g_autoptr(GUsbDevice) device = NULL;
+	const gchar *json = "{"
+			    "  \"UsbDevices\" : ["
+			    "    {"
+			    "      \"PlatformId\" : \"usb:AA:AA:19\","
+			    "      \"Tags\" : [\"emulation\"]"
+			    "    }"
+			    "  ]"
+			    "}";
+
+	/* UTF-16LE, where anything outside of ASCII is replaced */
+	rc = _g_usb_device_string_descriptor_to_ascii(buf, sizeof(buf), data, sizeof(data));
+	g_assert_cmpint(rc, ==, 4);
+	g_assert_cmpstr((const gchar *)data, ==, "Hi??");
+
+	/* truncated to the buffer, which is always NUL terminated */
+	rc = _g_usb_device_string_descriptor_to_ascii(buf, sizeof(buf), data, 2);
+	g_assert_cmpint(rc, ==, 1);
+	g_assert_cmpstr((const gchar *)data, ==, "H");
+
+	/* bLength is longer than the data, or not a string descriptor */
+	rc = _g_usb_device_string_descriptor_to_ascii(buf_short, sizeof(buf_short), data, 8);
+	g_assert_cmpint(rc, ==, LIBUSB_ERROR_IO);
+	rc = _g_usb_device_string_descriptor_to_ascii(buf_type, sizeof(buf_type), data, 8);
+	g_assert_cmpint(rc, ==, LIBUSB_ERROR_IO);
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	ret = _g_usb_context_load_json(ctx, json, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	device = g_usb_context_find_by_platform_id(ctx, "usb:AA:AA:19", &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(device);
+
+	/* a shorter request is served from the whole descriptor */
+	_g_usb_device_add_string_descriptor(device, 0x03, 0x0409, bytes);
+	bytes2 = _g_usb_device_lookup_string_descriptor(device, 0x03, 0x0409, 2);
+	g_assert_nonnull(bytes2);
+	g_assert_cmpint(g_bytes_get_size(bytes2), ==, 2);
+	g_assert_true(g_bytes_get_data(bytes2, NULL) == g_bytes_get_data(bytes, NULL));
+	bytes3 = _g_usb_device_lookup_string_descriptor(device, 0x03, 0x0409, 0xff);
+	g_assert_nonnull(bytes3);
+	g_assert_cmpint(g_bytes_get_size(bytes3), ==, sizeof(buf));
+
+	/* another language is not the same string */
+	g_assert_null(_g_usb_device_lookup_string_descriptor(device, 0x03, 0x0407, 0xff));
+
+	/* invalidated */
+	g_usb_device_invalidate(device);
+	bytes4 = _g_usb_device_lookup_string_descriptor(device, 0x03, 0x0409, 0xff);
+	g_assert_null(bytes4);
+}
+
+static void
+gusb_context_descriptor_cache_func(void)
+{
+	gboolean ret;
+	JsonArray *json_array = json_array_new();
+	JsonNode *json_node = json_node_new(JSON_NODE_ARRAY);
+	g_autofree gchar *filename = NULL;
+	g_autofree gchar *key2 = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GUsbContext) ctx = NULL;
+	g_autoptr(GUsbContext) ctx2 = NULL;
+	g_autoptr(GUsbContext) ctx3 = NULL;
+	g_autoptr(GPtrArray) devices = NULL;
+	g_autoptr(GPtrArray) hid_descriptors = NULL;
+	g_autoptr(JsonNode) json_node2 = NULL;
+	g_autoptr(JsonNode) json_node3 = NULL;
+	GUsbDevice *device;
+	GBytes *blob;
+	const gchar *key = "273f:1004:0100";
+	const gchar *cache_invalid = "{ \"UsbDescriptorCache\" : "
+				     "{ \"273f:1004:0100\" : { \"UsbHidDescriptors\" : 42 } } }";
+
+	ctx = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx != NULL);
+	json_array_add_string_element(json_array, "BgD/CQE=");
+	json_node_take_array(json_node, json_array);
+	_g_usb_context_set_cached_descriptors(ctx, key, "UsbHidDescriptors", json_node);
+
+	/* round trip */
+	filename = g_build_filename(g_get_tmp_dir(), "gusb-self-test-cache.json", NULL);
+	ret = g_usb_context_save_descriptor_cache(ctx, filename, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	ctx2 = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx2 != NULL);
+	ret = g_usb_context_load_descriptor_cache(ctx2, filename, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	g_unlink(filename);
+	json_node2 = _g_usb_context_get_cached_descriptors(ctx2, key, "UsbHidDescriptors");
+	g_assert_nonnull(json_node2);
+	json_array = json_node_get_array(json_node2);
+	g_assert_cmpint(json_array_get_length(json_array), ==, 1);
+	g_assert_cmpstr(json_array_get_string_element(json_array, 0), ==, "BgD/CQE=");
+
+	/* not cached, then removed */
+	g_assert_null(_g_usb_context_get_cached_descriptors(ctx2, key, "UsbInterfaces"));
+	_g_usb_context_remove_cached_descriptors(ctx2, key);
+	json_node3 = _g_usb_context_get_cached_descriptors(ctx2, key, "UsbHidDescriptors");
+	g_assert_null(json_node3);
+
+	/* a corrupt file is rejected as a whole */
+	ret = g_file_set_contents(filename, cache_invalid, -1, &error);
+	g_assert_no_error(error);
+	g_assert(ret);
+	ret = g_usb_context_load_descriptor_cache(ctx2, filename, &error);
+	g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+	g_assert(!ret);
+	g_clear_error(&error);
+	g_unlink(filename);
+	g_assert_null(_g_usb_context_get_cached_descriptors(ctx2, key, "UsbHidDescriptors"));
+
+	/* a device with the same firmware is served from the cache without being opened */
+	ctx3 = g_usb_context_new(&error);
+	g_assert_no_error(error);
+	g_assert(ctx3 != NULL);
+	g_usb_context_set_flags(ctx3, G_USB_CONTEXT_FLAGS_CACHE_DESCRIPTORS);
+	devices = g_usb_context_get_devices(ctx3);
+	g_assert_cmpint(devices->len, >, 0);
+	device = g_ptr_array_index(devices, 0);
+	key2 = g_strdup_printf("%04x:%04x:%04x",
+			       g_usb_device_get_vid(device),
+			       g_usb_device_get_pid(device),
+			       g_usb_device_get_release(device));
+	json_array = json_array_new();
+	json_array_add_string_element(json_array, "BgD/CQE=");
+	json_node = json_node_new(JSON_NODE_ARRAY);
+	json_node_take_array(json_node, json_array);
+	_g_usb_context_set_cached_descriptors(ctx3, key2, "UsbHidDescriptors", json_node);
+	hid_descriptors = g_usb_device_get_hid_descriptors(device, &error);
+	g_assert_no_error(error);
+	g_assert_nonnull(hid_descriptors);
+	g_assert_cmpint(hid_descriptors->len, ==, 1);
+	blob = g_ptr_array_index(hid_descriptors, 0);
+	g_assert_cmpint(g_bytes_get_size(blob), ==, 5);
+}
+
 static void
 gusb_device_ch2_func(void)
 {
@@ -707,6 +2238,32 @@ main(int argc, char **argv)
 	g_test_add_func("/gusb/device[munki]", gusb_device_munki_func);
 	g_test_add_func("/gusb/device[colorhug2]", gusb_device_ch2_func);
 	g_test_add_func("/gusb/device[json]", gusb_device_json_func);
+	g_test_add_func("/gusb/device[json-async]", gusb_device_json_async_func);
+	g_test_add_func("/gusb/context{archive}", gusb_context_archive_func);
+	g_test_add_func("/gusb/context{lazy}", gusb_context_lazy_func);
+	g_test_add_func("/gusb/context{lazy-invalid}", gusb_context_lazy_invalid_func);
+	g_test_add_func("/gusb/context{blobs}", gusb_context_blobs_func);
+	g_test_add_func("/gusb/device{repeat}", gusb_device_repeat_func);
+	g_test_add_func("/gusb/context{stream}", gusb_context_stream_func);
+	g_test_add_func("/gusb/context{delta}", gusb_context_delta_func);
+	g_test_add_func("/gusb/context{index}", gusb_context_index_func);
+	g_test_add_func("/gusb/context{match-rules}", gusb_context_match_rules_func);
+	g_test_add_func("/gusb/context{enumerate-async}", gusb_context_enumerate_async_func);
+	g_test_add_func("/gusb/context{enumerate-async-twice}",
+			gusb_context_enumerate_async_twice_func);
+	g_test_add_func("/gusb/context{enumerate-async-cancel}",
+			gusb_context_enumerate_async_cancel_func);
+	g_test_add_func("/gusb/context{hotplug-collapse}", gusb_context_hotplug_collapse_func);
+	g_test_add_func("/gusb/context{hotplug-debounce-timeout}",
+			gusb_context_hotplug_debounce_timeout_func);
+	g_test_add_func("/gusb/context{source}", gusb_context_source_func);
+	g_test_add_func("/gusb/context{source-main-ctx}", gusb_context_source_main_ctx_func);
+	g_test_add_func("/gusb/context{shards}", gusb_context_shards_func);
+	g_test_add_func("/gusb/context{snapshot}", gusb_context_snapshot_func);
+	g_test_add_func("/gusb/context{replug-async}", gusb_context_replug_async_func);
+	g_test_add_func("/gusb/context{descriptor-cache}", gusb_context_descriptor_cache_func);
+	g_test_add_func("/gusb/device{custom-index}", gusb_device_custom_index_func);
+	g_test_add_func("/gusb/device{string-descriptor}", gusb_device_string_descriptor_func);
 
 	return g_test_run();
 }
@@ -10,13 +10,25 @@
  * SECTION:gusb-source
  * @short_description: GSource integration for libusb
  *
- * This object used to integrate libusb into the GLib main loop before we used
- * a thread. It's now pretty much unused.
+ * This object integrates the libusb file descriptors and timeouts into a
+ * #GMainContext, so that events can be handled without a dedicated thread.
  */
 
 #include "config.h"
 
-#include "gusb-source.h"
+#include <poll.h>
+#include <stdlib.h>
+
+#include "gusb-context.h"
+#include "gusb-source-private.h"
+#include "gusb-util.h"
+
+struct _GUsbSource {
+	GSource source;
+	GSList *pollfds; /* of GPollFD */
+	GMutex pollfds_mutex; /* libusb notifies from whatever thread opens or closes a device */
+	libusb_context *ctx;
+};
 
 /**
  * g_usb_source_error_quark:
@@ -41,7 +53,7 @@ g_usb_source_error_quark(void)
  * @data: data to pass to @func
  * @notify: a #GDestroyNotify
  *
- * This function does nothing.
+ * Sets a function to call each time the libusb events have been handled.
  *
  * Since: 0.1.0
  **/
@@ -50,3 +62,180 @@ g_usb_source_set_callback(GUsbSource *self, GSourceFunc func, gpointer data, GDe
 {
 	g_source_set_callback((GSource *)self, func, data, notify);
 }
+
+static void
+g_usb_source_pollfd_add(GUsbSource *self, int fd, short events)
+{
+	GPollFD *pollfd = g_new0(GPollFD, 1);
+
+	pollfd->fd = fd;
+	if (events & POLLIN)
+		pollfd->events |= G_IO_IN;
+	if (events & POLLOUT)
+		pollfd->events |= G_IO_OUT;
+	g_mutex_lock(&self->pollfds_mutex);
+	self->pollfds = g_slist_prepend(self->pollfds, pollfd);
+	g_source_add_poll((GSource *)self, pollfd);
+	g_mutex_unlock(&self->pollfds_mutex);
+}
+
+static void
+g_usb_source_pollfd_added_cb(int fd, short events, void *user_data)
+{
+	GUsbSource *self = (GUsbSource *)user_data;
+	g_usb_source_pollfd_add(self, fd, events);
+}
+
+static void
+g_usb_source_pollfd_removed_cb(int fd, void *user_data)
+{
+	GUsbSource *self = (GUsbSource *)user_data;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&self->pollfds_mutex);
+
+	for (GSList *l = self->pollfds; l != NULL; l = l->next) {
+		GPollFD *pollfd = l->data;
+		if (pollfd->fd != fd)
+			continue;
+		g_source_remove_poll((GSource *)self, pollfd);
+		self->pollfds = g_slist_delete_link(self->pollfds, l);
+		g_free(pollfd);
+		return;
+	}
+	g_warning("couldn't find fd %d in list", fd);
+}
+
+/* libusb only needs a timeout when it cannot use a timerfd */
+static gboolean
+g_usb_source_prepare(GSource *source, gint *timeout)
+{
+	GUsbSource *self = (GUsbSource *)source;
+	struct timeval tv = {0};
+
+	if (libusb_get_next_timeout(self->ctx, &tv) != 1) {
+		*timeout = -1;
+		return FALSE;
+	}
+	if (tv.tv_sec == 0 && tv.tv_usec == 0) {
+		*timeout = 0;
+		return TRUE;
+	}
+
+	/* round up, so that we do not wake before the transfer has timed out */
+	*timeout = (gint)(tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000);
+	return FALSE;
+}
+
+static gboolean
+g_usb_source_check(GSource *source)
+{
+	GUsbSource *self = (GUsbSource *)source;
+	struct timeval tv = {0};
+	gboolean ready = FALSE;
+
+	g_mutex_lock(&self->pollfds_mutex);
+	for (GSList *l = self->pollfds; l != NULL; l = l->next) {
+		GPollFD *pollfd = l->data;
+		if (pollfd->revents) {
+			ready = TRUE;
+			break;
+		}
+	}
+	g_mutex_unlock(&self->pollfds_mutex);
+	if (ready)
+		return TRUE;
+	return libusb_get_next_timeout(self->ctx, &tv) == 1 && tv.tv_sec == 0 && tv.tv_usec == 0;
+}
+
+static gboolean
+g_usb_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data)
+{
+	GUsbSource *self = (GUsbSource *)source;
+	struct timeval tv = {0};
+	gint rc;
+
+	rc = libusb_handle_events_timeout(self->ctx, &tv);
+	if (rc < 0)
+		g_warning("failed to handle events: %s [%i]", g_usb_strerror(rc), rc);
+	if (callback != NULL)
+		return callback(user_data);
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+g_usb_source_finalize(GSource *source)
+{
+	GUsbSource *self = (GUsbSource *)source;
+	g_slist_free_full(self->pollfds, g_free);
+	g_mutex_clear(&self->pollfds_mutex);
+}
+
+static GSourceFuncs usb_source_funcs = {
+    g_usb_source_prepare,
+    g_usb_source_check,
+    g_usb_source_dispatch,
+    g_usb_source_finalize,
+};
+
+/**
+ * _g_usb_source_new:
+ * @main_ctx: a #GMainContext, or %NULL for the default
+ * @ctx: a libusb_context
+ * @error: a #GError, or %NULL
+ *
+ * Creates a source that handles the libusb events for @ctx, and attaches it
+ * to @main_ctx.
+ *
+ * Return value: (transfer full): a new #GUsbSource, or %NULL on error
+ *
+ * Since: 0.5.0
+ **/
+GUsbSource *
+_g_usb_source_new(GMainContext *main_ctx, libusb_context *ctx, GError **error)
+{
+	GUsbSource *self;
+	const struct libusb_pollfd **pollfds;
+
+	/* not supported on Windows */
+	pollfds = libusb_get_pollfds(ctx);
+	if (pollfds == NULL) {
+		g_set_error_literal(error,
+				    G_USB_CONTEXT_ERROR,
+				    G_USB_CONTEXT_ERROR_INTERNAL,
+				    "libusb_get_pollfds failed");
+		return NULL;
+	}
+
+	self = (GUsbSource *)g_source_new(&usb_source_funcs, sizeof(GUsbSource));
+	self->ctx = ctx;
+	g_mutex_init(&self->pollfds_mutex);
+	g_source_set_name((GSource *)self, "GUsbSource");
+	for (guint i = 0; pollfds[i] != NULL; i++)
+		g_usb_source_pollfd_add(self, pollfds[i]->fd, pollfds[i]->events);
+#ifdef HAVE_LIBUSB_FREE_POLLFDS
+	libusb_free_pollfds(pollfds);
+#else
+	free(pollfds);
+#endif
+	libusb_set_pollfd_notifiers(ctx,
+				    g_usb_source_pollfd_added_cb,
+				    g_usb_source_pollfd_removed_cb,
+				    self);
+	g_source_attach((GSource *)self, main_ctx);
+	return self;
+}
+
+/**
+ * _g_usb_source_destroy:
+ * @self: a #GUsbSource
+ *
+ * Stops handling libusb events, and frees the source.
+ *
+ * Since: 0.5.0
+ **/
+void
+_g_usb_source_destroy(GUsbSource *self)
+{
+	libusb_set_pollfd_notifiers(self->ctx, NULL, NULL, NULL);
+	g_source_destroy((GSource *)self);
+	g_source_unref((GSource *)self);
+}
@@ -259,9 +259,13 @@ gusb_cmd_show(GUsbCmdPrivate *priv, gchar **values, GError **error)
 {
 	g_autoptr(GNode) node = NULL;
 	g_autoptr(GPtrArray) devices = NULL;
+	g_autoptr(GPtrArray) devices_all = NULL;
 
-	/* sort */
-	devices = g_usb_context_get_devices(priv->usb_ctx);
+	/* sort a copy, as the array is shared with the context */
+	devices_all = g_usb_context_get_devices(priv->usb_ctx);
+	devices = g_ptr_array_new_with_free_func((GDestroyNotify)g_object_unref);
+	for (guint i = 0; i < devices_all->len; i++)
+		g_ptr_array_add(devices, g_object_ref(g_ptr_array_index(devices_all, i)));
 	g_ptr_array_sort(devices, gusb_devices_sort_by_platform_id_cb);
 
 	/* make a tree of the devices */
@@ -354,55 +358,66 @@ gusb_cmd_replug(GUsbCmdPrivate *priv, gchar **values, GError **error)
 	return device_new != NULL;
 }
 
+#define GUSB_CMD_ARCHIVE_SUFFIX ".gusb"
+#define GUSB_CMD_GZIP_SUFFIX	".gz"
+
 static gboolean
-gusb_cmd_load(GUsbCmdPrivate *priv, gchar **values, GError **error)
+gusb_cmd_load_filename(GUsbCmdPrivate *priv, const gchar *filename, GError **error)
 {
-	/* check args */
-	if (g_strv_length(values) == 0) {
-		g_set_error_literal(error,
-				    G_IO_ERROR,
-				    G_IO_ERROR_INVALID_ARGUMENT,
-				    "no filename specified");
-		return FALSE;
-	}
-
-	for (guint i = 0; values[i] != NULL; i++) {
-		JsonObject *json_obj;
-		JsonNode *json_node;
-		g_autoptr(JsonParser) parser = json_parser_new();
-
-		/* parse */
-		if (!json_parser_load_from_file(parser, values[i], error))
-			return FALSE;
-
-		/* sanity check */
-		json_node = json_parser_get_root(parser);
-		if (!JSON_NODE_HOLDS_OBJECT(json_node)) {
-			g_set_error_literal(error,
-					    G_IO_ERROR,
-					    G_IO_ERROR_INVALID_DATA,
-					    "not a JSON object");
-			return FALSE;
-		}
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(GFileInputStream) istream = NULL;
 
-		/* not supplied */
-		json_obj = json_node_get_object(json_node);
-		if (!g_usb_context_load(priv->usb_ctx, json_obj, error))
-			return FALSE;
-	}
+	/* binary archive */
+	if (g_str_has_suffix(filename, GUSB_CMD_ARCHIVE_SUFFIX))
+		return g_usb_context_load_archive(priv->usb_ctx, filename, NULL, error);
 
-	/* success */
-	return gusb_cmd_show(priv, NULL, error);
+	/* JSON, optionally compressed */
+	file = g_file_new_for_path(filename);
+	istream = g_file_read(file, NULL, error);
+	if (istream == NULL)
+		return FALSE;
+	return g_usb_context_load_stream(priv->usb_ctx, G_INPUT_STREAM(istream), NULL, NULL, error);
 }
 
 static gboolean
-gusb_cmd_save(GUsbCmdPrivate *priv, gchar **values, GError **error)
+gusb_cmd_save_filename(GUsbCmdPrivate *priv, const gchar *filename, GError **error)
 {
 	g_autofree gchar *data = NULL;
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(GFileOutputStream) ostream = NULL;
+	g_autoptr(GOutputStream) stream = NULL;
 	g_autoptr(JsonBuilder) json_builder = json_builder_new();
 	g_autoptr(JsonGenerator) json_generator = NULL;
 	g_autoptr(JsonNode) json_root = NULL;
 
+	/* binary archive */
+	if (filename != NULL && g_str_has_suffix(filename, GUSB_CMD_ARCHIVE_SUFFIX))
+		return g_usb_context_save_archive(priv->usb_ctx, filename, NULL, error);
+
+	/* save to file, compressing if required */
+	if (filename != NULL) {
+		file = g_file_new_for_path(filename);
+		ostream = g_file_replace(file,
+					 NULL,
+					 FALSE,
+					 G_FILE_CREATE_REPLACE_DESTINATION,
+					 NULL,
+					 error);
+		if (ostream == NULL)
+			return FALSE;
+		if (g_str_has_suffix(filename, GUSB_CMD_GZIP_SUFFIX)) {
+			g_autoptr(GZlibCompressor) compressor =
+			    g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+			stream = g_converter_output_stream_new(G_OUTPUT_STREAM(ostream),
+							       G_CONVERTER(compressor));
+		} else {
+			stream = G_OUTPUT_STREAM(g_object_ref(ostream));
+		}
+		if (!g_usb_context_save_stream(priv->usb_ctx, stream, NULL, NULL, error))
+			return FALSE;
+		return g_output_stream_close(stream, NULL, error);
+	}
+
 	if (!g_usb_context_save(priv->usb_ctx, json_builder, error))
 		return FALSE;
 
@@ -420,15 +435,54 @@ gusb_cmd_save(GUsbCmdPrivate *priv, gchar **values, GError **error)
 		return FALSE;
 	}
 
-	/* save to file */
-	if (g_strv_length(values) == 1)
-		return g_file_set_contents(values[0], data, -1, error);
-
 	/* just print */
 	g_print("%s\n", data);
 	return TRUE;
 }
 
+static gboolean
+gusb_cmd_load(GUsbCmdPrivate *priv, gchar **values, GError **error)
+{
+	/* check args */
+	if (g_strv_length(values) == 0) {
+		g_set_error_literal(error,
+				    G_IO_ERROR,
+				    G_IO_ERROR_INVALID_ARGUMENT,
+				    "no filename specified");
+		return FALSE;
+	}
+
+	for (guint i = 0; values[i] != NULL; i++) {
+		if (!gusb_cmd_load_filename(priv, values[i], error))
+			return FALSE;
+	}
+
+	/* success */
+	return gusb_cmd_show(priv, NULL, error);
+}
+
+static gboolean
+gusb_cmd_save(GUsbCmdPrivate *priv, gchar **values, GError **error)
+{
+	return gusb_cmd_save_filename(priv, g_strv_length(values) == 1 ? values[0] : NULL, error);
+}
+
+static gboolean
+gusb_cmd_convert(GUsbCmdPrivate *priv, gchar **values, GError **error)
+{
+	/* check args */
+	if (g_strv_length(values) != 2) {
+		g_set_error_literal(error,
+				    G_IO_ERROR,
+				    G_IO_ERROR_INVALID_ARGUMENT,
+				    "expected INPUT OUTPUT filenames");
+		return FALSE;
+	}
+	if (!gusb_cmd_load_filename(priv, values[0], error))
+		return FALSE;
+	return gusb_cmd_save_filename(priv, values[1], error);
+}
+
 static gboolean
 gusb_cmd_run(GUsbCmdPrivate *priv, const gchar *command, gchar **values, GError **error)
 {
@@ -532,6 +586,10 @@ main(int argc, char *argv[])
 	gusb_cmd_add(priv->cmd_array, "replug", "Watch a device as it reconnects", gusb_cmd_replug);
 	gusb_cmd_add(priv->cmd_array, "load", "Load a set of devices from JSON", gusb_cmd_load);
 	gusb_cmd_add(priv->cmd_array, "save", "Save a set of devices to JSON", gusb_cmd_save);
+	gusb_cmd_add(priv->cmd_array,
+		     "convert",
+		     "Convert between JSON and binary " GUSB_CMD_ARCHIVE_SUFFIX " archives",
+		     gusb_cmd_convert);
 
 	/* sort by command name */
 	g_ptr_array_sort(priv->cmd_array, (GCompareFunc)gusb_sort_command_name_cb);